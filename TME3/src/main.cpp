@@ -7,8 +7,10 @@
 #include <vector>
 #include <unordered_map>
 #include <ios>
+#include <cstdlib>
 #include "HashMap.h"
 #include "FileUtils.h"
+#include "util/profiler.h"
 
 using namespace std;
 
@@ -41,11 +43,18 @@ int main(int argc, char **argv)
 
         cout << "Preparing to parse " << filename << " (mode=" << mode << " N=" << num_threads << "), containing " << file_size << " bytes" << endl;
 
+        // PR_PROFILE=trace.json in the environment : profile with nested zones, see util/profiler.h
+        const char* profile_path = std::getenv("PR_PROFILE");
+        if (profile_path) {
+                pr::profile::enable();
+        }
+
         auto start = steady_clock::now();
 
         std::vector<std::pair<std::string, int>> pairs;
 
         if (mode == "freqstd") {
+                PR_PROFILE_ZONE("freqstd");
                 ifstream input(filename, std::ios::binary);
                 size_t total_words = 0;
                 size_t unique_words = 0;
@@ -61,9 +70,11 @@ int main(int argc, char **argv)
                 unique_words = um.size();
                 pairs.reserve(unique_words);
                 for (const auto& p : um) pairs.emplace_back(p);
+                PR_PROFILE_ZONE("printResults");
                 pr::printResults(total_words, unique_words, pairs, mode + ".freq");
 
         } else if (mode == "freqstdf") {
+                PR_PROFILE_ZONE("freqstdf");
                 size_t total_words = 0;
                 size_t unique_words = 0;
                 std::unordered_map<std::string, int> um;
@@ -74,9 +85,11 @@ int main(int argc, char **argv)
                 unique_words = um.size();
                 pairs.reserve(unique_words);
                 for (const auto& p : um) pairs.emplace_back(p);
+                PR_PROFILE_ZONE("printResults");
                 pr::printResults(total_words, unique_words, pairs, mode + ".freq");
 
         } else if (mode == "freq") {
+                PR_PROFILE_ZONE("freq");
                 size_t total_words = 0;
                 size_t unique_words = 0;
                 HashMap<std::string, int> hm;
@@ -86,6 +99,7 @@ int main(int argc, char **argv)
                 });
                 pairs = hm.toKeyValuePairs();
                 unique_words = pairs.size();
+                PR_PROFILE_ZONE("printResults");
                 pr::printResults(total_words, unique_words, pairs, mode + ".freq");
 
         } else {
@@ -97,6 +111,13 @@ int main(int argc, char **argv)
         auto end = steady_clock::now();
         cout << "Total runtime (wall clock) : " << duration_cast<milliseconds>(end - start).count() << " ms" << endl;
 
+        if (profile_path) {
+                pr::profile::report(cout);
+                if (!pr::profile::writeChromeTrace(profile_path)) {
+                        cerr << "Could not write trace to " << profile_path << endl;
+                }
+        }
+
         return 0;
 }
 
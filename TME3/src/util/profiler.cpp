@@ -0,0 +1,213 @@
+// profiler.cpp
+#include "profiler.h"
+#include "thread_timer.h"
+#include <algorithm>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace pr {
+namespace profile {
+
+namespace {
+
+// at most this many trace events per thread (about 40 bytes each) : on a long run the trace
+// keeps the beginning, while the flat profile still counts every zone
+constexpr size_t MAX_TRACE_EVENTS = size_t(1) << 20;
+
+// a closed zone, for the Chrome trace
+struct Event {
+    const char* name;
+    uint64_t start_ns; // wall clock, since the profiler epoch
+    uint64_t wall_ns;
+    uint64_t cpu_ns;
+};
+
+// a zone path of one thread, e.g. "treatImage/load" : its stats are summed as its zones close,
+// so the memory is bounded by the number of distinct paths, not by the number of calls
+struct Node {
+    const char* name;
+    int parent; // -1 at top level
+    std::vector<int> children;
+    size_t calls = 0;
+    uint64_t wall = 0, self = 0, cpu = 0;
+};
+
+// an open zone
+struct Open {
+    int node;
+    uint64_t start_ns;
+    uint64_t cpu_start_ns;
+    uint64_t children_ns = 0; // wall time of the zones closed inside it
+};
+
+// only ever touched by its owning thread while recording, read after the threads are joined
+struct ThreadBuffer {
+    int tid;
+    std::vector<Node> nodes;
+    std::vector<Open> open; // the stack of open zones, innermost last
+    std::vector<Event> events;
+    size_t dropped = 0; // events not kept in the trace, beyond MAX_TRACE_EVENTS
+
+    // the node of name under parent (-1 : top level), created at its first use
+    int child(int parent, const char* name) {
+        for (int c : parent < 0 ? roots : nodes[parent].children) {
+            // names are usually the same literal, compare the text in case they are not
+            if (nodes[c].name == name || std::strcmp(nodes[c].name, name) == 0) {
+                return c;
+            }
+        }
+        int c = int(nodes.size());
+        nodes.push_back(Node{name, parent, {}});
+        (parent < 0 ? roots : nodes[parent].children).push_back(c);
+        return c;
+    }
+
+    std::vector<int> roots;
+};
+
+std::atomic<bool> g_enabled{false};
+const std::chrono::steady_clock::time_point g_epoch = std::chrono::steady_clock::now();
+// the buffers outlive their threads, so that we can aggregate at exit
+std::mutex g_mtx;
+std::vector<std::unique_ptr<ThreadBuffer>> g_buffers;
+
+uint64_t wallNs() {
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - g_epoch).count());
+}
+
+ThreadBuffer& localBuffer() {
+    thread_local ThreadBuffer* buffer = nullptr;
+    if (!buffer) {
+        // once per thread
+        std::unique_lock lock(g_mtx);
+        g_buffers.push_back(std::make_unique<ThreadBuffer>());
+        buffer = g_buffers.back().get();
+        buffer->tid = int(g_buffers.size());
+    }
+    return *buffer;
+}
+
+} // namespace
+
+void enable() {
+    g_enabled.store(true, std::memory_order_relaxed);
+}
+
+bool enabled() {
+    return g_enabled.load(std::memory_order_relaxed);
+}
+
+Zone::Zone(const char* name) : index_(-1) {
+    if (!g_enabled.load(std::memory_order_relaxed)) {
+        return;
+    }
+    ThreadBuffer& buffer = localBuffer();
+    int node = buffer.child(buffer.open.empty() ? -1 : buffer.open.back().node, name);
+    index_ = int(buffer.open.size());
+    buffer.open.push_back({node, wallNs(), thread_timer::threadCpuNs()});
+}
+
+Zone::~Zone() {
+    if (index_ < 0) {
+        return;
+    }
+    ThreadBuffer& buffer = localBuffer();
+    const Open o = buffer.open.back();
+    buffer.open.pop_back();
+    const uint64_t wall = wallNs() - o.start_ns;
+    const uint64_t cpu = thread_timer::threadCpuNs() - o.cpu_start_ns;
+    Node& n = buffer.nodes[o.node];
+    n.calls++;
+    n.wall += wall;
+    n.self += wall > o.children_ns ? wall - o.children_ns : 0;
+    n.cpu += cpu;
+    if (!buffer.open.empty()) {
+        buffer.open.back().children_ns += wall;
+    }
+    if (buffer.events.size() < MAX_TRACE_EVENTS) {
+        buffer.events.push_back({n.name, o.start_ns, wall, cpu});
+    } else {
+        buffer.dropped++;
+    }
+}
+
+void report(std::ostream& os) {
+    struct Aggregate {
+        size_t calls = 0;
+        uint64_t wall = 0, self = 0, cpu = 0;
+    };
+    // keyed by the components of the path : a parent is a prefix of its children, so it sorts
+    // right before them, and each subtree stays contiguous (unlike sorting "a/b" as a string,
+    // which comes after "a b")
+    std::map<std::vector<std::string>, Aggregate> flat;
+    size_t dropped = 0;
+    {
+        std::unique_lock lock(g_mtx);
+        for (const auto& buffer : g_buffers) {
+            const auto& nodes = buffer->nodes;
+            std::vector<std::vector<std::string>> paths(nodes.size());
+            for (size_t i = 0; i < nodes.size(); ++i) {
+                // parents are always created first
+                if (nodes[i].parent >= 0) {
+                    paths[i] = paths[nodes[i].parent];
+                }
+                paths[i].push_back(nodes[i].name);
+                if (nodes[i].calls == 0) {
+                    continue; // still running, nothing meaningful to report
+                }
+                Aggregate& a = flat[paths[i]];
+                a.calls += nodes[i].calls;
+                a.wall += nodes[i].wall;
+                a.self += nodes[i].self;
+                a.cpu += nodes[i].cpu;
+            }
+            dropped += buffer->dropped;
+        }
+    }
+    os << "Profile (all threads):" << std::endl;
+    os << "  " << std::left << std::setw(40) << "zone" << std::right << std::setw(10) << "calls" << std::setw(14) << "wall ms"
+       << std::setw(14) << "self ms" << std::setw(14) << "cpu ms" << std::endl;
+    os << std::fixed << std::setprecision(1);
+    for (const auto& [path, a] : flat) {
+        std::string label = std::string(2 * (path.size() - 1), ' ') + path.back();
+        os << "  " << std::left << std::setw(40) << label << std::right << std::setw(10) << a.calls << std::setw(14) << a.wall / 1e6
+           << std::setw(14) << a.self / 1e6 << std::setw(14) << a.cpu / 1e6 << std::endl;
+    }
+    os << std::defaultfloat;
+    if (dropped > 0) {
+        os << "  (" << dropped << " zones left out of the trace, beyond " << MAX_TRACE_EVENTS << " per thread)" << std::endl;
+    }
+}
+
+bool writeChromeTrace(const std::string& path) {
+    std::ofstream out(path);
+    if (!out) {
+        return false;
+    }
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    bool first = true;
+    std::unique_lock lock(g_mtx);
+    for (const auto& buffer : g_buffers) {
+        for (const Event& e : buffer->events) {
+            // complete events ("X"), timestamps in microseconds
+            out << (first ? "" : ",") << "\n{\"name\": \"" << e.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer->tid
+                << ", \"ts\": " << e.start_ns / 1e3 << ", \"dur\": " << e.wall_ns / 1e3
+                << ", \"args\": {\"cpu_us\": " << e.cpu_ns / 1e3 << "}}";
+            first = false;
+        }
+    }
+    out << "\n]}\n";
+    return bool(out);
+}
+
+} // namespace profile
+} // namespace pr
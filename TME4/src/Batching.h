@@ -0,0 +1,67 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef> // for size_t
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+namespace pr {
+
+// a group of small files, processed back to back by a single worker
+using FileBatch = std::vector<std::filesystem::path>;
+
+/**
+ * Adaptive size of the batches of small files.
+ * For a thumbnail, the actual work is comparable to the per task overhead : queue handoff,
+ * waking up a worker, setting up an encoder. Grouping files amortizes that overhead, but
+ * batches that are too large hurt load balance, in particular at the end of the run where
+ * one worker may still chew on a long batch while the others are idle.
+ *
+ * So we aim at batches that take about a target duration : workers report the time they
+ * spent per image, folded into an exponentially weighted moving average, and the producer
+ * sizes the next batch as target / average, within [1, max_size].
+ * All methods are lock-free and can be called from any thread.
+ */
+class BatchSizer {
+public:
+    BatchSizer(std::chrono::microseconds target, size_t max_size, size_t initial_size = 8)
+        : target_ns_(uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(target).count())),
+          max_size_(std::max<size_t>(1, max_size)), initial_size_(std::clamp<size_t>(initial_size, 1, max_size_)) {}
+
+    // a worker processed count images in ns nanoseconds
+    void record(uint64_t ns, size_t count) {
+        if (count == 0) {
+            return;
+        }
+        uint64_t sample = ns / count;
+        uint64_t prev = avg_ns_.load(std::memory_order_relaxed);
+        uint64_t next;
+        do {
+            // weight 1/8 for the new sample ; the first one is taken as is
+            next = prev == 0 ? std::max<uint64_t>(sample, 1) : prev - prev / 8 + sample / 8;
+        } while (!avg_ns_.compare_exchange_weak(prev, next, std::memory_order_relaxed));
+    }
+
+    // number of files for the next batch
+    size_t batchSize() const {
+        uint64_t avg = avg_ns_.load(std::memory_order_relaxed);
+        if (avg == 0) {
+            return initial_size_; // nothing measured yet
+        }
+        return std::clamp<size_t>(size_t(target_ns_ / avg), 1, max_size_);
+    }
+
+    // current average time per image, 0 before the first measure
+    uint64_t averageNs() const { return avg_ns_.load(std::memory_order_relaxed); }
+
+private:
+    const uint64_t target_ns_;
+    const size_t max_size_;
+    const size_t initial_size_;
+    std::atomic<uint64_t> avg_ns_{0};
+};
+
+} // namespace pr
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef> // for size_t
+#include <memory>
+#include <thread>
+#include <utility>
+
+namespace pr {
+
+/**
+ * Wait policies for the blocking push/pop of MPMCQueue.
+ * A policy is asked to wait while an operation cannot proceed : it receives the atomic
+ * counter whose change would unblock us, and the value we last saw there.
+ *
+ * SpinWait: busy loop, yielding the CPU. Lowest latency, but burns a core per waiting thread.
+ * SpinThenFutexWait: spin a bit, then sleep in the kernel using C++20 atomic wait/notify,
+ * which maps to futex on Linux. Waiters cost nothing, notifications are a syscall only
+ * when someone actually sleeps.
+ */
+struct SpinWait {
+    static constexpr bool notifies = false;
+    static void wait(const std::atomic<size_t>& /*counter*/, size_t /*seen*/, int round) {
+        if (round > 64) {
+            std::this_thread::yield();
+        }
+    }
+};
+
+struct SpinThenFutexWait {
+    static constexpr bool notifies = true;
+    static void wait(const std::atomic<size_t>& counter, size_t seen, int round) {
+        if (round < 64) {
+            return; // retry immediately, the other side is probably mid-operation
+        }
+        // returns immediately if counter != seen. The queue bumps the counter only after the
+        // cell is published (seq store), and the waiter read seen before its failed attempt :
+        // either that attempt saw the cell, or the counter moved since, so no lost wakeup
+        counter.wait(seen, std::memory_order_acquire);
+    }
+};
+
+/**
+ * Lock-free bounded multi-producer multi-consumer queue, after Dmitry Vyukov's design.
+ * Drop-in alternative to BoundedBlockingQueue : same blocking push/pop interface,
+ * plus non-blocking try_push/try_pop.
+ *
+ * The buffer is a ring of cells, each carrying a sequence number that tells whose turn it is:
+ * - seq == pos : the cell is free for the producer that reserved position pos
+ * - seq == pos+1 : the cell holds data for the consumer that reserved position pos
+ * Producers and consumers reserve positions with a CAS on tail_/head_ respectively,
+ * so they never contend on the same cache line as long as the queue is neither full nor empty.
+ *
+ * The capacity is rounded up to a power of two so that modulo is a mask.
+ * T must be default constructible and move assignable.
+ */
+template <typename T, typename WaitPolicy = SpinThenFutexWait>
+class MPMCQueue {
+    // 64 on all our targets ; std::hardware_destructive_interference_size warns on gcc (ABI)
+    static constexpr size_t CACHE_LINE = 64;
+
+    struct Cell {
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+public:
+    explicit MPMCQueue(size_t max_size)
+        : mask_(roundUp(max_size) - 1), cells_(new Cell[mask_ + 1]) {
+        for (size_t i = 0; i <= mask_; ++i) {
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+        }
+        tail_.store(0, std::memory_order_relaxed);
+        head_.store(0, std::memory_order_relaxed);
+    }
+
+    MPMCQueue(const MPMCQueue&) = delete;
+    MPMCQueue& operator=(const MPMCQueue&) = delete;
+
+    // non blocking, returns false if full
+    bool try_push(const T& value) {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells_[pos & mask_];
+            size_t seq = cell.seq.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                // cell is free at our turn, try to reserve it
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.data = value;
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    if constexpr (WaitPolicy::notifies) {
+                        // after the seq store : see SpinThenFutexWait
+                        pushed_.fetch_add(1, std::memory_order_release);
+                        pushed_.notify_all();
+                    }
+                    return true;
+                }
+                // CAS failure reloaded pos, retry
+            } else if (diff < 0) {
+                return false; // full : the consumer of the previous lap did not free it yet
+            } else {
+                pos = tail_.load(std::memory_order_relaxed); // overtaken, catch up
+            }
+        }
+    }
+
+    // non blocking, returns false if empty
+    bool try_pop(T& value) {
+        size_t pos = head_.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells_[pos & mask_];
+            size_t seq = cell.seq.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    value = std::move(cell.data);
+                    // free the cell for the producer of the next lap
+                    cell.seq.store(pos + mask_ + 1, std::memory_order_release);
+                    if constexpr (WaitPolicy::notifies) {
+                        popped_.fetch_add(1, std::memory_order_release);
+                        popped_.notify_all();
+                    }
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // empty
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // blocking while full
+    void push(const T& value) {
+        for (int round = 0;; ++round) {
+            // read the counter *before* trying, consumers bump it once they have freed a cell
+            size_t seen = popped_.load(std::memory_order_acquire);
+            if (try_push(value)) {
+                return;
+            }
+            WaitPolicy::wait(popped_, seen, round);
+        }
+    }
+
+    // blocking while empty
+    T pop() {
+        T value;
+        for (int round = 0;; ++round) {
+            size_t seen = pushed_.load(std::memory_order_acquire);
+            if (try_pop(value)) {
+                return value;
+            }
+            WaitPolicy::wait(pushed_, seen, round);
+        }
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+
+private:
+    static size_t roundUp(size_t n) {
+        size_t p = 2; // at least 2 cells, the algorithm degenerates with 1
+        while (p < n) {
+            p <<= 1;
+        }
+        return p;
+    }
+
+    const size_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+    // producers and consumers each on their own cache line, away from the read-mostly fields
+    alignas(CACHE_LINE) std::atomic<size_t> tail_; // next position to push
+    alignas(CACHE_LINE) std::atomic<size_t> head_; // next position to pop
+    // completed pushes and pops, bumped after the cell's seq store, for the waiters only
+    // (SpinThenFutexWait) : tail_/head_ move at reservation, before the cell is published
+    alignas(CACHE_LINE) std::atomic<size_t> pushed_{0};
+    alignas(CACHE_LINE) std::atomic<size_t> popped_{0};
+};
+
+} // namespace pr
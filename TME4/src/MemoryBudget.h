@@ -0,0 +1,68 @@
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <cstddef> // for size_t
+
+namespace pr {
+
+/**
+ * Admission control on the bytes of decoded images in flight, across all the stages.
+ * The queues bound the number of items, but ten 50 Mpixel images is 2 GB : we bound the
+ * memory instead. A stage calls acquire(n) before decoding an image of n bytes, and the
+ * last stage calls release(n) once the image is saved and its memory freed.
+ *
+ * acquire blocks while the budget would be exceeded, with two rules to stay live and fair:
+ * - an acquire is always granted when nothing is in flight, so an image larger than the
+ *   whole budget still goes through (alone) instead of deadlocking ;
+ * - requests are granted in arrival order (ticket), so a large image is not starved by
+ *   a stream of small ones that would fit in the remaining budget.
+ */
+class MemoryBudget {
+public:
+    explicit MemoryBudget(size_t max_bytes) : max_bytes_(max_bytes) {}
+
+    void acquire(size_t bytes) {
+        std::unique_lock lock(mtx_);
+        size_t ticket = next_ticket_++;
+        cv_.wait(lock, [&] {
+            return ticket == serving_ && (in_flight_ == 0 || in_flight_ + bytes <= max_bytes_);
+        });
+        serving_++;
+        in_flight_ += bytes;
+        peak_ = std::max(peak_, in_flight_);
+        lock.unlock();
+        cv_.notify_all(); // next ticket may fit too
+    }
+
+    void release(size_t bytes) {
+        {
+            std::unique_lock lock(mtx_);
+            in_flight_ -= bytes;
+        }
+        cv_.notify_all();
+    }
+
+    size_t inFlight() const {
+        std::unique_lock lock(mtx_);
+        return in_flight_;
+    }
+
+    // high-water mark of bytes in flight
+    size_t peak() const {
+        std::unique_lock lock(mtx_);
+        return peak_;
+    }
+
+private:
+    const size_t max_bytes_;
+    size_t in_flight_ = 0;
+    size_t peak_ = 0;
+    size_t next_ticket_ = 0;
+    size_t serving_ = 0;
+    mutable std::mutex mtx_;
+    std::condition_variable cv_;
+};
+
+} // namespace pr
@@ -1,24 +1,63 @@
 #include "Tasks.h"
 #include "util/ImageUtils.h"
 #include "util/thread_timer.h"
+#include "util/profiler.h"
+#include <chrono>
 #include <thread>
 #include <sstream>
 
 namespace pr {
 
-void treatImage(FileQueue& fileQueue, const std::filesystem::path& outputFolder) {
+// one file, start to end ; saver is a reusable encoder, or nullptr for saveImage
+static void treatOne(const std::filesystem::path& file, const std::filesystem::path& outputFolder, const StageContext& ctx, ImageSaver* saver) {
+    size_t bytes = 0;
+    if (ctx.budget) {
+        bytes = pr::estimateImageBytes(file);
+        ctx.budget->acquire(bytes);
+    }
+    {
+        // before loading : the stamp of the content that is converted
+        std::optional<Manifest::Stamp> stamp;
+        if (ctx.manifest) {
+            stamp = Manifest::stamp(file);
+        }
+        QImage original;
+        {
+            PipelineStats::Scope scope(ctx.stats, PipelineStats::Load);
+            PR_PROFILE_ZONE("load");
+            original = pr::loadImage(file, ctx.pool);
+        }
+        if (!original.isNull()) {
+            QImage resized;
+            {
+                PipelineStats::Scope scope(ctx.stats, PipelineStats::Resize);
+                PR_PROFILE_ZONE("resize");
+                resized = pr::resizeImage(original, ctx.pool, ctx.resize, ctx.resizeThreads);
+            }
+            std::filesystem::path outputFile = pr::outputPathFor(ctx.inputFolder, outputFolder, file);
+            PipelineStats::Scope scope(ctx.stats, PipelineStats::Save);
+            PR_PROFILE_ZONE("save");
+            bool saved = saver ? saver->save(resized, outputFile) : pr::saveImage(resized, outputFile);
+            if (saved && stamp) {
+                ctx.manifest->record(file, *stamp);
+            }
+        }
+    } // images freed here
+    if (ctx.budget) {
+        ctx.budget->release(bytes);
+    }
+}
+
+template <typename FileQ>
+void treatImage(FileQ& fileQueue, const std::filesystem::path& outputFolder, const StageContext& ctx) {
     // measure CPU time in this thread
     pr::thread_timer timer;
+    PR_PROFILE_ZONE("treatImage");
     
     while (true) {
-        std::filesystem::path file = fileQueue.pop();
+        std::filesystem::path file = timedPop(fileQueue, ctx);
         if (file == pr::FILE_POISON) break; // poison pill
-        QImage original = pr::loadImage(file);
-        if (!original.isNull()) {
-            QImage resized = pr::resizeImage(original);
-            std::filesystem::path outputFile = outputFolder / file.filename();
-            pr::saveImage(resized, outputFile);
-        }
+        treatOne(file, outputFolder, ctx, nullptr);
     }
 
     // trace
@@ -27,38 +66,128 @@ void treatImage(FileQueue& fileQueue, const std::filesystem::path& outputFolder)
     std::cout << ss.str();
 }
 
+template <typename BatchQ>
+void treatBatch(BatchQ& batchQueue, const std::filesystem::path& outputFolder, const StageContext& ctx) {
+    pr::thread_timer timer;
+    PR_PROFILE_ZONE("treatBatch");
+    ImageSaver saver; // encoder set up once for all the images of this thread
+    size_t batches = 0, images = 0;
 
-/*
-void reader(FileQueue& fileQueue, ImageTaskQueue& imageQueue) {
+    while (true) {
+        FileBatch* batch = timedPop(batchQueue, ctx);
+        if (batch == pr::BATCH_POISON) break;
+        auto start = std::chrono::steady_clock::now();
+        for (const auto& file : *batch) {
+            treatOne(file, outputFolder, ctx, &saver);
+        }
+        if (ctx.batch) {
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            ctx.batch->record(uint64_t(ns), batch->size());
+        }
+        batches++;
+        images += batch->size();
+        delete batch;
+    }
+
+    std::stringstream ss;
+    ss << "Thread " << std::this_thread::get_id() << " (treatBatch): " << timer << " ms CPU, "
+       << images << " images in " << batches << " batches" << std::endl;
+    std::cout << ss.str();
+}
+
+
+template <typename FileQ, typename TaskQ>
+void reader(FileQ& fileQueue, TaskQ& imageQueue, const StageContext& ctx) {
     pr::thread_timer timer;
+    PR_PROFILE_ZONE("reader");
     while (true) {
-     // TODO
+        std::filesystem::path file = timedPop(fileQueue, ctx);
+        if (file == pr::FILE_POISON) break;
+        size_t bytes = 0;
+        if (ctx.budget) {
+            // block here, before decoding, while too much is in flight downstream
+            bytes = pr::estimateImageBytes(file);
+            ctx.budget->acquire(bytes);
+        }
+        std::optional<Manifest::Stamp> stamp;
+        if (ctx.manifest) {
+            stamp = Manifest::stamp(file);
+        }
+        QImage image;
+        {
+            PipelineStats::Scope scope(ctx.stats, PipelineStats::Load);
+            PR_PROFILE_ZONE("load");
+            image = pr::loadImage(file, ctx.pool);
+        }
+        if (image.isNull()) {
+            if (ctx.budget) {
+                ctx.budget->release(bytes);
+            }
+            continue; // already reported by loadImage
+        }
+        timedPush(imageQueue, new TaskData{file, std::move(image), bytes, stamp}, ctx);
     }
     std::stringstream ss;
     ss << "Thread " << std::this_thread::get_id() << " (reader): " << timer << " ms CPU" << std::endl;
     std::cout << ss.str();
 }
 
-void resizer(ImageTaskQueue& imageQueue, ImageTaskQueue& resizedQueue) {
+template <typename TaskQ>
+void resizer(TaskQ& imageQueue, TaskQ& resizedQueue, const StageContext& ctx) {
     pr::thread_timer timer;
+    PR_PROFILE_ZONE("resizer");
     while (true) {
-// TODO
+        TaskData* task = timedPop(imageQueue, ctx);
+        if (task == pr::TASK_POISON) break;
+        {
+            PipelineStats::Scope scope(ctx.stats, PipelineStats::Resize);
+            PR_PROFILE_ZONE("resize");
+            task->image = pr::resizeImage(task->image, ctx.pool, ctx.resize, ctx.resizeThreads); // original buffer is recycled here
+        }
+        timedPush(resizedQueue, task, ctx);
     }
     std::stringstream ss;
     ss << "Thread " << std::this_thread::get_id() << " (resizer): " << timer << " ms CPU" << std::endl;
     std::cout << ss.str();
 }
 
-void saver(ImageTaskQueue& resizedQueue, const std::filesystem::path& outputFolder) {
+template <typename TaskQ>
+void saver(TaskQ& resizedQueue, const std::filesystem::path& outputFolder, const StageContext& ctx) {
     pr::thread_timer timer;
+    PR_PROFILE_ZONE("saver");
     while (true) {
-    // TODO
+        TaskData* task = timedPop(resizedQueue, ctx);
+        if (task == pr::TASK_POISON) break;
+        {
+            PipelineStats::Scope scope(ctx.stats, PipelineStats::Save);
+            PR_PROFILE_ZONE("save");
+            if (pr::saveImage(task->image, pr::outputPathFor(ctx.inputFolder, outputFolder, task->file)) && task->stamp) {
+                ctx.manifest->record(task->file, *task->stamp);
+            }
+        }
+        size_t bytes = task->bytes;
+        delete task; // and the resized buffer here
+        if (ctx.budget) {
+            ctx.budget->release(bytes);
+        }
     }
     std::stringstream ss;
     ss << "Thread " << std::this_thread::get_id() << " (saver): " << timer << " ms CPU" << std::endl;
     std::cout << ss.str();
 }
-*/
 
+// explicit instantiations : mutex based queues
+template void treatImage<FileQueue>(FileQueue&, const std::filesystem::path&, const StageContext&);
+template void treatBatch<BatchQueue>(BatchQueue&, const std::filesystem::path&, const StageContext&);
+template void reader<FileQueue, ImageTaskQueue>(FileQueue&, ImageTaskQueue&, const StageContext&);
+template void resizer<ImageTaskQueue>(ImageTaskQueue&, ImageTaskQueue&, const StageContext&);
+template void saver<ImageTaskQueue>(ImageTaskQueue&, const std::filesystem::path&, const StageContext&);
+
+// explicit instantiations : lock-free queues
+template void treatImage<FileQueueLF>(FileQueueLF&, const std::filesystem::path&, const StageContext&);
+template void treatBatch<BatchQueueLF>(BatchQueueLF&, const std::filesystem::path&, const StageContext&);
+template void reader<FileQueueLF, ImageTaskQueueLF>(FileQueueLF&, ImageTaskQueueLF&, const StageContext&);
+template void resizer<ImageTaskQueueLF>(ImageTaskQueueLF&, ImageTaskQueueLF&, const StageContext&);
+template void saver<ImageTaskQueueLF>(ImageTaskQueueLF&, const std::filesystem::path&, const StageContext&);
 
-} // namespace pr
\ No newline at end of file
+} // namespace pr
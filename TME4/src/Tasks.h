@@ -3,31 +3,88 @@
 
 #include <QImage>
 #include <filesystem>
+#include <optional>
+#include "Batching.h"
 #include "BoundedBlockingQueue.h"
+#include "MPMCQueue.h"
+#include "MemoryBudget.h"
+#include "util/ImagePool.h"
+#include "util/ImageUtils.h"
+#include "util/Manifest.h"
+#include "util/PipelineStats.h"
 
 namespace pr {
 
+// The stages below are templates over the queue types, so that the pipeline can run
+// either on the mutex/condition based BoundedBlockingQueue or on the lock-free MPMCQueue.
+// They are explicitly instantiated for both families in Tasks.cpp.
 using FileQueue = BoundedBlockingQueue<std::filesystem::path>;
+using FileQueueLF = MPMCQueue<std::filesystem::path>;
 
 const std::filesystem::path FILE_POISON{};
 
+// services shared by all the stages of a run, each one optional (nullptr = not used)
+struct StageContext {
+    std::filesystem::path inputFolder; // root of the scan : outputs mirror the paths below it (cf. outputPathFor)
+    ImagePool* pool = nullptr; // recycled pixel buffers for decode and resize
+    MemoryBudget* budget = nullptr; // cap on decoded bytes in flight, acquired before decode, released after save
+    ResizeMethod resize = ResizeMethod::Qt; // resize algorithm
+    int resizeThreads = 1; // threads per image for the SIMD downscaler
+    PipelineStats* stats = nullptr; // latency histograms and throughput
+    BatchSizer* batch = nullptr; // informed of the time per image by treatBatch
+    Manifest* manifest = nullptr; // incremental runs : inputs are recorded once their output is saved
+};
+
+// queue operations, timed when stats are enabled : this measures the time spent blocked
+template <typename Q>
+auto timedPop(Q& queue, const StageContext& ctx) {
+    PipelineStats::Scope scope(ctx.stats, PipelineStats::QueuePop);
+    return queue.pop();
+}
+
+template <typename Q, typename T>
+void timedPush(Q& queue, const T& value, const StageContext& ctx) {
+    PipelineStats::Scope scope(ctx.stats, PipelineStats::QueuePush);
+    queue.push(value);
+}
+
 // load/resize/save 
-void treatImage(FileQueue& fileQueue, const std::filesystem::path& outputFolder);
+template <typename FileQ>
+void treatImage(FileQ& fileQueue, const std::filesystem::path& outputFolder, const StageContext& ctx);
 
+// batches of small files, heap allocated by the producer, deleted by treatBatch
+using BatchQueue = BoundedBlockingQueue<FileBatch*>;
+using BatchQueueLF = MPMCQueue<FileBatch*>;
 
+FileBatch* const BATCH_POISON = nullptr;
+
+// load/resize/save every file of a batch back to back, reusing one encoder per thread,
+// and report the time per image to ctx.batch
+template <typename BatchQ>
+void treatBatch(BatchQ& batchQueue, const std::filesystem::path& outputFolder, const StageContext& ctx);
+
+
+// an image in flight between the stages : heap allocated by reader, deleted by saver
 struct TaskData {
-    // TODO
+    std::filesystem::path file;
+    QImage image;
+    size_t bytes = 0; // taken from the memory budget by reader, given back by saver
+    std::optional<Manifest::Stamp> stamp; // of the input, taken by reader before loading, when there is a manifest
 };
 
-//using ImageTaskQueue = BoundedBlockingQueue<TaskData*>;
-// or
-//using ImageTaskQueue = BoundedBlockingQueue<TaskData>;
+// pointers : cheap to copy in and out of the queue, and nullptr is a natural poison
+using ImageTaskQueue = BoundedBlockingQueue<TaskData*>;
+using ImageTaskQueueLF = MPMCQueue<TaskData*>;
+
+TaskData* const TASK_POISON = nullptr;
 
-// TODO
-//void reader(FileQueue& fileQueue, ImageTaskQueue& imageQueue);
-//void resizer(ImageTaskQueue& imageQueue, ImageTaskQueue& resizedQueue);
-//void saver(ImageTaskQueue& resizedQueue, const std::filesystem::path& outputFolder);
+template <typename FileQ, typename TaskQ>
+void reader(FileQ& fileQueue, TaskQ& imageQueue, const StageContext& ctx);
+template <typename TaskQ>
+void resizer(TaskQ& imageQueue, TaskQ& resizedQueue, const StageContext& ctx);
+template <typename TaskQ>
+void saver(TaskQ& resizedQueue, const std::filesystem::path& outputFolder, const StageContext& ctx);
 
 } // namespace pr
 
-#endif // TASKS_H
\ No newline at end of file
+#endif // TASKS_H
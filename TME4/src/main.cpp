@@ -9,6 +9,8 @@
 #include <chrono>
 #include <cstdlib>
 #include <sstream>
+#include <memory>
+#include <fstream>
 
 #include "util/CLI11.hpp" // Header only lib for argument parsing
 
@@ -17,24 +19,218 @@
 #include "Tasks.h"
 #include "util/thread_timer.h"
 #include "util/processRSS.h"
+#include "util/profiler.h"
 
 struct Options {
     std::filesystem::path inputFolder = "input_images/";
     std::filesystem::path outputFolder = "output_images/";
     std::string mode = "resize";
     int num_threads = 4;
+    std::string queue = "blocking";
+    int queue_size = 10;
+    int nbread = 1;
+    int nbresize = 1;
+    int nbwrite = 1;
+    int pool_mb = 0;
+    int budget_mb = 0;
+    std::string resizer = "qt";
+    int resize_threads = 1;
+    pr::ScanOptions scan;
+    bool stats = false;
+    int stats_period_ms = 1000;
+    std::string stats_json;
+    std::string profile;
+    int rss_interval_ms = 0;
+    std::string rss_csv;
+    int batch_kb = 0;
+    int batch_ms = 20;
+    bool incremental = false;
+    std::filesystem::path manifest;
 
   friend std::ostream &operator<<(std::ostream &os, const Options &opts) {
     os << "input folder '" << opts.inputFolder.string() 
        << "', output folder '" << opts.outputFolder.string() 
        << "', mode '" << opts.mode 
-       << "', nthreads " << opts.num_threads;
+       << "', nthreads " << opts.num_threads
+       << ", queue " << opts.queue << "(" << opts.queue_size << ")"
+       << ", resizer " << opts.resizer;
+    if (opts.scan.recursive || opts.scan.threads > 1 || opts.scan.prefetch > 0) {
+       os << ", scan " << (opts.scan.recursive ? "recursive" : "flat") << " threads " << opts.scan.threads
+          << " prefetch " << opts.scan.prefetch;
+    }
+    if (opts.mode == "mt_pipeline") {
+       os << ", read/resize/write " << opts.nbread << "/" << opts.nbresize << "/" << opts.nbwrite;
+    }
+    if (opts.pool_mb > 0) {
+       os << ", image pool " << opts.pool_mb << " MB";
+    }
+    if (opts.budget_mb > 0) {
+       os << ", memory budget " << opts.budget_mb << " MB";
+    }
     return os;
   }
 };
 
 int parseOptions(int argc, char *argv[], Options& opts);
 
+pr::ResizeMethod toResizeMethod(const std::string& name) {
+    if (name == "box") return pr::ResizeMethod::Box;
+    if (name == "bilinear") return pr::ResizeMethod::Bilinear;
+    return pr::ResizeMethod::Qt;
+}
+
+// Loads every image once, then times each resize method on it, without any I/O in the measure.
+void benchResize(const Options& opts) {
+    const std::pair<const char*, pr::ResizeMethod> methods[] = {
+        {"qt", pr::ResizeMethod::Qt}, {"box", pr::ResizeMethod::Box}, {"bilinear", pr::ResizeMethod::Bilinear}};
+    double total_ms[3] = {0, 0, 0};
+    size_t pixels = 0;
+    pr::findImageFiles(opts.inputFolder, [&](const std::filesystem::path& file) {
+        QImage original = pr::loadImage(file);
+        if (original.isNull()) {
+            return;
+        }
+        pixels += size_t(original.width()) * original.height();
+        for (int m = 0; m < 3; m++) {
+            auto start = std::chrono::steady_clock::now();
+            QImage resized = pr::resizeImage(original, nullptr, methods[m].second, opts.resize_threads);
+            total_ms[m] += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+    }, opts.scan);
+    std::cout << "Resize benchmark (downscaler ISA " << pr::downscaleIsa() << ", " << opts.resize_threads << " thread(s)) on "
+              << pixels / 1000000 << " Mpixels:" << std::endl;
+    for (int m = 0; m < 3; m++) {
+        std::cout << "  " << methods[m].first << ": " << size_t(total_ms[m]) << " ms";
+        if (total_ms[m] > 0) {
+            std::cout << ", " << size_t(pixels / total_ms[m] / 1000) << " Mpixels/s, x" << total_ms[0] / total_ms[m] << " vs qt";
+        }
+        std::cout << std::endl;
+    }
+}
+
+// The input images, in the order of findImageFiles, minus those that are up to date
+// when running incrementally.
+static void scanInputs(const Options& opts, const pr::StageContext& ctx, const std::function<void(const std::filesystem::path&)>& callback) {
+    pr::findImageFiles(opts.inputFolder, [&](const std::filesystem::path& file) {
+        if (ctx.manifest && ctx.manifest->upToDate(file, pr::outputPathFor(opts.inputFolder, opts.outputFolder, file))) {
+            return;
+        }
+        callback(file);
+    }, opts.scan);
+}
+
+// The pipelined modes, parameterized by the queue types so that we can compare
+// the mutex based BoundedBlockingQueue with the lock-free MPMCQueue on the same workload.
+template <typename FileQ, typename TaskQ, typename BatchQ>
+void runPipeline(const Options& opts, const pr::StageContext& ctx) {
+    PR_PROFILE_ZONE("pipeline");
+    if ((opts.mode == "pipe" || opts.mode == "pipe_mt") && ctx.batch) {
+        // same as below, but small files travel in batches, sized by ctx.batch
+        BatchQ batchQueue(opts.queue_size);
+        int nbworkers = opts.mode == "pipe" ? 1 : opts.num_threads;
+
+        std::vector<std::thread> workers;
+        for (int i = 0; i < nbworkers; i++) {
+            workers.emplace_back(pr::treatBatch<BatchQ>, std::ref(batchQueue), std::cref(opts.outputFolder), std::cref(ctx));
+        }
+
+        const std::uintmax_t small = std::uintmax_t(opts.batch_kb) * 1024;
+        pr::FileBatch* pending = new pr::FileBatch();
+        scanInputs(opts, ctx, [&](const std::filesystem::path& file) {
+            std::error_code ec;
+            std::uintmax_t size = std::filesystem::file_size(file, ec);
+            if (ec || size >= small) {
+                // large enough to be worth a task of its own
+                pr::timedPush(batchQueue, new pr::FileBatch{file}, ctx);
+                return;
+            }
+            pending->push_back(file);
+            if (pending->size() >= ctx.batch->batchSize()) {
+                pr::timedPush(batchQueue, pending, ctx);
+                pending = new pr::FileBatch();
+            }
+        });
+        if (!pending->empty()) {
+            pr::timedPush(batchQueue, pending, ctx);
+        } else {
+            delete pending;
+        }
+
+        for (int i = 0; i < nbworkers; i++) {
+            batchQueue.push(pr::BATCH_POISON);
+        }
+        for (auto& t : workers) {
+            t.join();
+        }
+    } else if (opts.mode == "pipe" || opts.mode == "pipe_mt") {
+        // 1. Pipeline: file discovery -> treatImage (load/resize/save)
+        FileQ fileQueue(opts.queue_size);
+        // single worker in "pipe" mode
+        int nbworkers = opts.mode == "pipe" ? 1 : opts.num_threads;
+
+        // 2. Start the worker threads
+        std::vector<std::thread> workers;
+        for (int i = 0; i < nbworkers; i++) {
+            workers.emplace_back(pr::treatImage<FileQ>, std::ref(fileQueue), std::cref(opts.outputFolder), std::cref(ctx));
+        }
+
+        // 3. Populate file queue synchronously
+        scanInputs(opts, ctx, [&](const std::filesystem::path& file) {
+            pr::timedPush(fileQueue, file, ctx);
+        });
+
+        // 4. Push one poison pill per worker
+        for (int i = 0; i < nbworkers; i++) {
+            fileQueue.push(pr::FILE_POISON);
+        }
+
+        // 5. Join the worker threads
+        for (auto& t : workers) {
+            t.join();
+        }
+    } else if (opts.mode == "mt_pipeline") {
+        // file discovery -> reader (load) -> resizer -> saver, each stage with its own threads
+        FileQ fileQueue(opts.queue_size);
+        TaskQ imageQueue(opts.queue_size);
+        TaskQ resizedQueue(opts.queue_size);
+
+        std::vector<std::thread> readers, resizers, savers;
+        for (int i = 0; i < opts.nbread; i++) {
+            readers.emplace_back(pr::reader<FileQ, TaskQ>, std::ref(fileQueue), std::ref(imageQueue), std::cref(ctx));
+        }
+        for (int i = 0; i < opts.nbresize; i++) {
+            resizers.emplace_back(pr::resizer<TaskQ>, std::ref(imageQueue), std::ref(resizedQueue), std::cref(ctx));
+        }
+        for (int i = 0; i < opts.nbwrite; i++) {
+            savers.emplace_back(pr::saver<TaskQ>, std::ref(resizedQueue), std::cref(opts.outputFolder), std::cref(ctx));
+        }
+
+        scanInputs(opts, ctx, [&](const std::filesystem::path& file) {
+            pr::timedPush(fileQueue, file, ctx);
+        });
+
+        // termination : poison a stage once its producers are all done
+        for (int i = 0; i < opts.nbread; i++) {
+            fileQueue.push(pr::FILE_POISON);
+        }
+        for (auto& t : readers) {
+            t.join();
+        }
+        for (int i = 0; i < opts.nbresize; i++) {
+            imageQueue.push(pr::TASK_POISON);
+        }
+        for (auto& t : resizers) {
+            t.join();
+        }
+        for (int i = 0; i < opts.nbwrite; i++) {
+            resizedQueue.push(pr::TASK_POISON);
+        }
+        for (auto& t : savers) {
+            t.join();
+        }
+    }
+}
+
 int main(int argc, char *argv[]) {
     QCoreApplication app(argc, argv);  // Initialize Qt for image format plugins
 
@@ -48,41 +244,123 @@ int main(int argc, char *argv[]) {
 
     std::cout << "Image resizer starting with " << opts << std::endl;
 
+    if (!opts.profile.empty()) {
+        pr::profile::enable();
+    }
+
     auto start_time = std::chrono::steady_clock::now();
     pr::thread_timer main_timer;
 
+    // optional recycling of pixel buffers, shared by all stages
+    std::unique_ptr<pr::ImagePool> pool;
+    pr::StageContext ctx;
+    ctx.inputFolder = opts.inputFolder;
+    if (opts.pool_mb > 0) {
+        pool = std::make_unique<pr::ImagePool>(size_t(opts.pool_mb) * 1024 * 1024);
+        ctx.pool = pool.get();
+    }
+    // optional cap on the decoded bytes in flight in the pipelines
+    std::unique_ptr<pr::MemoryBudget> budget;
+    if (opts.budget_mb > 0) {
+        budget = std::make_unique<pr::MemoryBudget>(size_t(opts.budget_mb) * 1024 * 1024);
+        ctx.budget = budget.get();
+    }
+    ctx.resize = toResizeMethod(opts.resizer);
+    ctx.resizeThreads = opts.resize_threads;
+    // optional incremental run : skip the inputs converted by a previous run
+    std::unique_ptr<pr::Manifest> manifest;
+    if (opts.incremental) {
+        manifest = std::make_unique<pr::Manifest>(opts.manifest.empty() ? opts.outputFolder / ".resize-manifest" : opts.manifest);
+        ctx.manifest = manifest.get();
+    }
+    // optional batching of small files in the pipe modes, batches of about batch_ms
+    std::unique_ptr<pr::BatchSizer> batch;
+    if (opts.batch_kb > 0) {
+        batch = std::make_unique<pr::BatchSizer>(std::chrono::milliseconds(opts.batch_ms), 64);
+        ctx.batch = batch.get();
+    }
+    // optional instrumentation : histograms, periodic one line report, JSON dump at the end
+    std::unique_ptr<pr::PipelineStats> stats;
+    if (opts.stats || !opts.stats_json.empty()) {
+        stats = std::make_unique<pr::PipelineStats>();
+        stats->startReporter(std::chrono::milliseconds(opts.stats_period_ms > 0 ? opts.stats_period_ms : 1000), opts.stats_period_ms > 0);
+        ctx.stats = stats.get();
+    }
+    // optional memory timeline, in two phases : the mode, then the teardown
+    std::unique_ptr<process::RSSSampler> sampler;
+    if (opts.rss_interval_ms > 0 || !opts.rss_csv.empty()) {
+        int interval = opts.rss_interval_ms > 0 ? opts.rss_interval_ms : 10;
+        // each sample also records the pipeline progress, when we have it
+        sampler = std::make_unique<process::RSSSampler>(std::chrono::milliseconds(interval), [&ctx]() -> std::string {
+            if (!ctx.stats) {
+                return "";
+            }
+            return "loaded " + std::to_string(ctx.stats->histogram(pr::PipelineStats::Load).count())
+                 + " resized " + std::to_string(ctx.stats->histogram(pr::PipelineStats::Resize).count())
+                 + " saved " + std::to_string(ctx.stats->histogram(pr::PipelineStats::Save).count());
+        });
+        sampler->start();
+        sampler->mark(opts.mode);
+    }
+
     if (opts.mode == "resize") {
+        PR_PROFILE_ZONE("sequential");
         // Single-threaded: direct load/resize/save in callback
-        pr::findImageFiles(opts.inputFolder, [&](const std::filesystem::path& file) {
-            QImage original = pr::loadImage(file);
+        scanInputs(opts, ctx, [&](const std::filesystem::path& file) {
+            std::optional<pr::Manifest::Stamp> stamp;
+            if (ctx.manifest) {
+                stamp = pr::Manifest::stamp(file); // before loading
+            }
+            QImage original;
+            {
+                pr::PipelineStats::Scope scope(ctx.stats, pr::PipelineStats::Load);
+                PR_PROFILE_ZONE("load");
+                original = pr::loadImage(file, ctx.pool);
+            }
             if (!original.isNull()) {
-                QImage resized = pr::resizeImage(original);
-                std::filesystem::path outputFile = opts.outputFolder / file.filename();
-                pr::saveImage(resized, outputFile);
+                QImage resized;
+                {
+                    pr::PipelineStats::Scope scope(ctx.stats, pr::PipelineStats::Resize);
+                    PR_PROFILE_ZONE("resize");
+                    resized = pr::resizeImage(original, ctx.pool, ctx.resize, ctx.resizeThreads);
+                }
+                std::filesystem::path outputFile = pr::outputPathFor(opts.inputFolder, opts.outputFolder, file);
+                pr::PipelineStats::Scope scope(ctx.stats, pr::PipelineStats::Save);
+                PR_PROFILE_ZONE("save");
+                if (pr::saveImage(resized, outputFile) && stamp) {
+                    ctx.manifest->record(file, *stamp);
+                }
             }
         });
-    } else if (opts.mode == "pipe") {
-        // 1. Single-threaded pipeline: file discovery -> treatImage (load/resize/save)
-        pr::FileQueue fileQueue(10);
-
-        // 2. Start the worker thread
-        std::thread worker(pr::treatImage, std::ref(fileQueue), std::ref(opts.outputFolder));
-
-        // 3. Populate file queue synchronously
-        pr::findImageFiles(opts.inputFolder, [&](const std::filesystem::path& file) {
-            fileQueue.push(file);
-        });
-
-        // 4. Push poison pill
-        fileQueue.push(pr::FILE_POISON);
-
-        // 5. Join the worker thread
-        worker.join();
+    } else if (opts.mode == "resize_bench") {
+        benchResize(opts);
+    } else if (opts.mode == "pipe" || opts.mode == "pipe_mt" || opts.mode == "mt_pipeline") {
+        if (opts.queue == "lockfree") {
+            runPipeline<pr::FileQueueLF, pr::ImageTaskQueueLF, pr::BatchQueueLF>(opts, ctx);
+        } else {
+            runPipeline<pr::FileQueue, pr::ImageTaskQueue, pr::BatchQueue>(opts, ctx);
+        }
     } else {
-        std::cerr << "Unknown mode '" << opts.mode << "'. Supported modes: resize, pipe" << std::endl;
+        std::cerr << "Unknown mode '" << opts.mode << "'. Supported modes: resize, resize_bench, pipe, pipe_mt, mt_pipeline" << std::endl;
         return 1;
     }
 
+    if (sampler) {
+        sampler->mark("teardown");
+    }
+
+    if (stats) {
+        stats->stopReporter();
+        std::cout << "Stats: " << stats->summaryLine() << std::endl;
+        if (!opts.stats_json.empty()) {
+            std::ofstream json(opts.stats_json);
+            stats->writeJson(json);
+            if (!json) {
+                std::cerr << "Could not write stats to " << opts.stats_json << std::endl;
+            }
+        }
+    }
+
     std::stringstream ss;
     ss << "Thread " << std::this_thread::get_id() << " (main): " << main_timer << " ms CPU" << std::endl;
     std::cout << ss.str();
@@ -92,10 +370,37 @@ int main(int argc, char *argv[]) {
 
     // Report memory usage at the end
     std::cout << "Memory usage: " << process::getResidentMemory() << std::endl;
+    if (pool) {
+        std::cout << "Image pool: " << pool->stats() << std::endl;
+    }
+    if (budget) {
+        std::cout << "Memory budget: peak in flight " << budget->peak() / (1024 * 1024) << " MB of " << opts.budget_mb << " MB" << std::endl;
+    }
+    if (manifest) {
+        manifest->save();
+        std::cout << "Incremental: " << manifest->skipped() << " up to date images skipped, " << manifest->recorded() << " converted" << std::endl;
+    }
+    if (batch) {
+        std::cout << "Batching: " << batch->averageNs() / 1000 << " us per small image, batches of " << batch->batchSize() << " files" << std::endl;
+    }
+    if (sampler) {
+        sampler->stop();
+        sampler->report(std::cout);
+        if (!opts.rss_csv.empty() && !sampler->writeCsv(opts.rss_csv)) {
+            std::cerr << "Could not write memory timeline to " << opts.rss_csv << std::endl;
+        }
+    }
 
     // Report total CPU time across all timers
     std::cout << "Total CPU time across all threads: " << pr::thread_timer::getTotalCpuTimeMs() << " ms" << std::endl;
 
+    if (!opts.profile.empty()) {
+        pr::profile::report(std::cout);
+        if (!pr::profile::writeChromeTrace(opts.profile)) {
+            std::cerr << "Could not write trace to " << opts.profile << std::endl;
+        }
+    }
+
     return 0;
 }
 
@@ -111,13 +416,87 @@ int parseOptions(int argc, char *argv[], Options& opts) {
         ->default_str(default_opts.outputFolder.string());
 
     cli_app.add_option("-m,--mode", opts.mode, "Processing mode")
-        ->check(CLI::IsMember({"resize", "pipe" /*, "pipe_mt" */})) // TODO : add modes
+        ->check(CLI::IsMember({"resize", "resize_bench", "pipe", "pipe_mt", "mt_pipeline"}))
         ->default_str(default_opts.mode);
 
     cli_app.add_option("-n,--nthreads", opts.num_threads, "Number of threads")
         ->check(CLI::PositiveNumber)
         ->default_val(default_opts.num_threads);
 
+    cli_app.add_option("-q,--queue", opts.queue, "Queue implementation used by the pipelines")
+        ->check(CLI::IsMember({"blocking", "lockfree"}))
+        ->default_str(default_opts.queue);
+
+    cli_app.add_option("--queue-size", opts.queue_size, "Capacity of the pipeline queues (lockfree rounds up to a power of two)")
+        ->check(CLI::PositiveNumber)
+        ->default_val(default_opts.queue_size);
+
+    cli_app.add_option("--nbread", opts.nbread, "Number of reader threads (mt_pipeline)")
+        ->check(CLI::PositiveNumber)
+        ->default_val(default_opts.nbread);
+
+    cli_app.add_option("--nbresize", opts.nbresize, "Number of resizer threads (mt_pipeline)")
+        ->check(CLI::PositiveNumber)
+        ->default_val(default_opts.nbresize);
+
+    cli_app.add_option("--nbwrite", opts.nbwrite, "Number of saver threads (mt_pipeline)")
+        ->check(CLI::PositiveNumber)
+        ->default_val(default_opts.nbwrite);
+
+    cli_app.add_option("--pool-mb", opts.pool_mb, "Recycle pixel buffers, keeping at most this many idle MB (0 = no pool)")
+        ->check(CLI::NonNegativeNumber)
+        ->default_val(default_opts.pool_mb);
+
+    cli_app.add_option("--budget-mb", opts.budget_mb, "Block the readers while more than this many MB of decoded images are in flight (0 = unbounded)")
+        ->check(CLI::NonNegativeNumber)
+        ->default_val(default_opts.budget_mb);
+
+    cli_app.add_option("-r,--resizer", opts.resizer, "Resize algorithm: Qt smooth scaling, or SIMD 2x2 box / bilinear downscaler")
+        ->check(CLI::IsMember({"qt", "box", "bilinear"}))
+        ->default_str(default_opts.resizer);
+
+    cli_app.add_option("--resize-threads", opts.resize_threads, "Threads per image for the box/bilinear resizer on very large images")
+        ->check(CLI::PositiveNumber)
+        ->default_val(default_opts.resize_threads);
+
+    cli_app.add_flag("--recursive", opts.scan.recursive, "Also process images in subfolders (outputs keep their subfolders under the output folder)");
+
+    cli_app.add_option("--scan-threads", opts.scan.threads, "Threads listing folders in parallel")
+        ->check(CLI::PositiveNumber)
+        ->default_val(default_opts.scan.threads);
+
+    cli_app.add_option("--prefetch", opts.scan.prefetch, "Number of upcoming files to hint for read-ahead (0 = none)")
+        ->check(CLI::NonNegativeNumber)
+        ->default_val(default_opts.scan.prefetch);
+
+    cli_app.add_flag("--stats", opts.stats, "Per stage latency histograms, queue waits and throughput, reported periodically");
+
+    cli_app.add_option("--stats-period", opts.stats_period_ms, "Period of the one line stats report in ms (0 = only at the end)")
+        ->check(CLI::NonNegativeNumber)
+        ->default_val(default_opts.stats_period_ms);
+
+    cli_app.add_option("--stats-json", opts.stats_json, "Write the final stats as JSON to this file (implies --stats)");
+
+    cli_app.add_option("--profile", opts.profile, "Profile with nested zones : print a flat profile, write a Chrome trace (JSON) to this file");
+
+    cli_app.add_option("--rss-interval", opts.rss_interval_ms, "Sample the RSS every this many ms in the background, report the timeline and its peak (0 = off)")
+        ->check(CLI::NonNegativeNumber)
+        ->default_val(default_opts.rss_interval_ms);
+
+    cli_app.add_option("--rss-csv", opts.rss_csv, "Write the memory timeline as CSV to this file (implies --rss-interval, 10 ms by default)");
+
+    cli_app.add_option("--batch-kb", opts.batch_kb, "pipe modes: files under this size (KB) are grouped in batches handled by one worker (0 = no batching)")
+        ->check(CLI::NonNegativeNumber)
+        ->default_val(default_opts.batch_kb);
+
+    cli_app.add_option("--batch-ms", opts.batch_ms, "Target duration of a batch : its size adapts to the measured time per image")
+        ->check(CLI::PositiveNumber)
+        ->default_val(default_opts.batch_ms);
+
+    cli_app.add_flag("--incremental", opts.incremental, "Only convert the images that changed since the last run (see --manifest)");
+
+    cli_app.add_option("--manifest", opts.manifest, "Manifest of converted images for --incremental (default: .resize-manifest in the output folder)");
+
     try {
         cli_app.parse(argc, argv);
     } catch (const CLI::CallForHelp &e) {
@@ -0,0 +1,283 @@
+// Downscale.cpp
+#include "Downscale.h"
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PR_DOWNSCALE_X86 1
+#include <immintrin.h>
+#endif
+
+namespace pr {
+
+namespace {
+
+// Tiles of destination pixels : 256 pixels wide (2 KB of source per row), 32 rows high.
+// A tile only touches ~66 source rows x 2 KB, which stays in L2 whatever the image width.
+constexpr int TILE_W = 256;
+constexpr int TILE_H = 32;
+// below this many destination pixels, threads cost more than they bring
+constexpr size_t MT_THRESHOLD = 1 << 20;
+
+/*****************************************************************************
+ * Kernels. Each exists in scalar, SSE2 and AVX2 flavors, they compute the same values.
+ * Pixels are 4 bytes, channels are processed independently.
+ *****************************************************************************/
+
+// Box : destination pixels [x0,x1) of one row, from source rows r0, r1
+void boxRowScalar(const uint8_t* r0, const uint8_t* r1, uint8_t* d, int x0, int x1) {
+    for (int x = x0; x < x1; ++x) {
+        const uint8_t* a = r0 + 8 * x;
+        const uint8_t* b = r1 + 8 * x;
+        for (int c = 0; c < 4; ++c) {
+            d[4 * x + c] = uint8_t((a[c] + a[c + 4] + b[c] + b[c + 4] + 2) >> 2);
+        }
+    }
+}
+
+// Bilinear vertical pass : out = a + 3 (b + c) + d over n bytes, widened to 16 bits (max 2040)
+void tentColumnScalar(const uint8_t* a, const uint8_t* b, const uint8_t* c, const uint8_t* d, uint16_t* out, int n) {
+    for (int i = 0; i < n; ++i) {
+        out[i] = uint16_t(a[i] + 3 * (b[i] + c[i]) + d[i]);
+    }
+}
+
+// Bilinear horizontal pass : destination pixel j from tmp pixels 2j..2j+3, weights 1 3 3 1
+void tentRowScalar(const uint16_t* tmp, uint8_t* d, int count) {
+    for (int j = 0; j < count; ++j) {
+        const uint16_t* t = tmp + 8 * j;
+        for (int c = 0; c < 4; ++c) {
+            d[4 * j + c] = uint8_t((t[c] + 3 * (t[c + 4] + t[c + 8]) + t[c + 12] + 32) >> 6);
+        }
+    }
+}
+
+#ifdef PR_DOWNSCALE_X86
+
+// 4 source pixels of two rows -> 2 destination pixels as 16 bit lanes
+__attribute__((target("sse2"))) inline __m128i box4Sse2(const uint8_t* r0, const uint8_t* r1) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r0));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r1));
+    // vertical sums : px0,px1 | px2,px3
+    __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+    __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+    // horizontal : [px0,px2] + [px1,px3]
+    __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+    return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+}
+
+__attribute__((target("sse2"))) void boxRowSse2(const uint8_t* r0, const uint8_t* r1, uint8_t* d, int x0, int x1) {
+    int x = x0;
+    for (; x + 4 <= x1; x += 4) {
+        __m128i p01 = box4Sse2(r0 + 8 * x, r1 + 8 * x);
+        __m128i p23 = box4Sse2(r0 + 8 * x + 16, r1 + 8 * x + 16);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 4 * x), _mm_packus_epi16(p01, p23));
+    }
+    boxRowScalar(r0, r1, d, x, x1);
+}
+
+__attribute__((target("sse2"))) void tentColumnSse2(const uint8_t* a, const uint8_t* b, const uint8_t* c, const uint8_t* d, uint16_t* out, int n) {
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        __m128i vc = _mm_loadu_si128(reinterpret_cast<const __m128i*>(c + i));
+        __m128i vd = _mm_loadu_si128(reinterpret_cast<const __m128i*>(d + i));
+        for (int half = 0; half < 2; ++half) {
+            __m128i wa = half ? _mm_unpackhi_epi8(va, zero) : _mm_unpacklo_epi8(va, zero);
+            __m128i wb = half ? _mm_unpackhi_epi8(vb, zero) : _mm_unpacklo_epi8(vb, zero);
+            __m128i wc = half ? _mm_unpackhi_epi8(vc, zero) : _mm_unpacklo_epi8(vc, zero);
+            __m128i wd = half ? _mm_unpackhi_epi8(vd, zero) : _mm_unpacklo_epi8(vd, zero);
+            __m128i mid = _mm_add_epi16(wb, wc);
+            mid = _mm_add_epi16(mid, _mm_slli_epi16(mid, 1)); // x3
+            __m128i r = _mm_add_epi16(_mm_add_epi16(wa, wd), mid);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 8 * half), r);
+        }
+    }
+    tentColumnScalar(a + i, b + i, c + i, d + i, out + i, n - i);
+}
+
+__attribute__((target("sse2"))) void tentRowSse2(const uint16_t* tmp, uint8_t* d, int count) {
+    int j = 0;
+    for (; j + 2 <= count; j += 2) {
+        // for each destination pixel : [t0+t3 , t1+t2] with the pixels t0..t3 it depends on
+        __m128i s[2];
+        for (int k = 0; k < 2; ++k) {
+            const uint16_t* t = tmp + 8 * (j + k);
+            __m128i t01 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(t));
+            __m128i t23 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(t + 8));
+            s[k] = _mm_add_epi16(t01, _mm_shuffle_epi32(t23, _MM_SHUFFLE(1, 0, 3, 2)));
+        }
+        __m128i outer = _mm_unpacklo_epi64(s[0], s[1]);
+        __m128i inner = _mm_unpackhi_epi64(s[0], s[1]);
+        inner = _mm_add_epi16(inner, _mm_slli_epi16(inner, 1)); // x3
+        __m128i r = _mm_add_epi16(_mm_add_epi16(outer, inner), _mm_set1_epi16(32));
+        r = _mm_srli_epi16(r, 6);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(d + 4 * j), _mm_packus_epi16(r, r));
+    }
+    tentRowScalar(tmp + 8 * j, d + 4 * j, count - j);
+}
+
+// 8 source pixels of two rows -> 4 destination pixels as 16 bit lanes, in order [d0,d1 | d2,d3]
+__attribute__((target("avx2"))) inline __m256i box8Avx2(const uint8_t* r0, const uint8_t* r1) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r0));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r1));
+    // unpack works per 128 bit lane : lo = [px0,px1 | px4,px5], hi = [px2,px3 | px6,px7]
+    __m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero));
+    __m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero));
+    __m256i sum = _mm256_add_epi16(_mm256_unpacklo_epi64(lo, hi), _mm256_unpackhi_epi64(lo, hi));
+    return _mm256_srli_epi16(_mm256_add_epi16(sum, _mm256_set1_epi16(2)), 2);
+}
+
+__attribute__((target("avx2"))) void boxRowAvx2(const uint8_t* r0, const uint8_t* r1, uint8_t* d, int x0, int x1) {
+    int x = x0;
+    for (; x + 8 <= x1; x += 8) {
+        __m256i p0 = box8Avx2(r0 + 8 * x, r1 + 8 * x);           // d0 d1 | d2 d3
+        __m256i p1 = box8Avx2(r0 + 8 * x + 32, r1 + 8 * x + 32); // d4 d5 | d6 d7
+        // pack interleaves lanes : d0 d1 d4 d5 | d2 d3 d6 d7, restore the order
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(p0, p1), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(d + 4 * x), packed);
+    }
+    boxRowSse2(r0, r1, d, x, x1);
+}
+
+__attribute__((target("avx2"))) void tentColumnAvx2(const uint8_t* a, const uint8_t* b, const uint8_t* c, const uint8_t* d, uint16_t* out, int n) {
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i wa = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)));
+        __m256i wb = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+        __m256i wc = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(c + i)));
+        __m256i wd = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(d + i)));
+        __m256i mid = _mm256_add_epi16(wb, wc);
+        mid = _mm256_add_epi16(mid, _mm256_slli_epi16(mid, 1));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_add_epi16(_mm256_add_epi16(wa, wd), mid));
+    }
+    tentColumnScalar(a + i, b + i, c + i, d + i, out + i, n - i);
+}
+
+#endif // PR_DOWNSCALE_X86
+
+struct Kernels {
+    void (*boxRow)(const uint8_t*, const uint8_t*, uint8_t*, int, int);
+    void (*tentColumn)(const uint8_t*, const uint8_t*, const uint8_t*, const uint8_t*, uint16_t*, int);
+    void (*tentRow)(const uint16_t*, uint8_t*, int);
+    const char* isa;
+};
+
+// chosen once, from what the CPU running us supports
+const Kernels& kernels() {
+    static const Kernels k = [] {
+#ifdef PR_DOWNSCALE_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            // no wide horizontal tent : its 4-pixel window straddles the 128 bit lanes
+            return Kernels{boxRowAvx2, tentColumnAvx2, tentRowSse2, "avx2"};
+        }
+        if (__builtin_cpu_supports("sse2")) {
+            return Kernels{boxRowSse2, tentColumnSse2, tentRowSse2, "sse2"};
+        }
+#endif
+        return Kernels{boxRowScalar, tentColumnScalar, tentRowScalar, "scalar"};
+    }();
+    return k;
+}
+
+struct Job {
+    const uint8_t* src;
+    size_t srcStride;
+    int srcWidth, srcHeight;
+    uint8_t* dst;
+    size_t dstStride;
+    int dstWidth;
+};
+
+void boxBand(const Job& job, int y0, int y1) {
+    const Kernels& k = kernels();
+    for (int ty = y0; ty < y1; ty += TILE_H) {
+        int tyEnd = std::min(ty + TILE_H, y1);
+        for (int tx = 0; tx < job.dstWidth; tx += TILE_W) {
+            int txEnd = std::min(tx + TILE_W, job.dstWidth);
+            for (int y = ty; y < tyEnd; ++y) {
+                const uint8_t* r0 = job.src + size_t(2 * y) * job.srcStride;
+                k.boxRow(r0, r0 + job.srcStride, job.dst + size_t(y) * job.dstStride, tx, txEnd);
+            }
+        }
+    }
+}
+
+void bilinearBand(const Job& job, int y0, int y1) {
+    const Kernels& k = kernels();
+    // vertical sums for the source pixels 2*tx-1 .. 2*txEnd of one tile row, edges clamped
+    std::vector<uint16_t> tmp(size_t(2 * TILE_W + 2) * 4);
+    for (int ty = y0; ty < y1; ty += TILE_H) {
+        int tyEnd = std::min(ty + TILE_H, y1);
+        for (int tx = 0; tx < job.dstWidth; tx += TILE_W) {
+            int txEnd = std::min(tx + TILE_W, job.dstWidth);
+            int first = 2 * tx - 1;                             // source column of tmp[0]
+            int lo = std::max(first, 0);                        // clamped range actually read
+            int hi = std::min(2 * txEnd + 1, job.srcWidth);     // exclusive
+            int needed = 2 * (txEnd - tx) + 2;                  // tmp pixels used by the tile
+            for (int y = ty; y < tyEnd; ++y) {
+                auto row = [&](int sy) {
+                    sy = std::clamp(sy, 0, job.srcHeight - 1);
+                    return job.src + size_t(sy) * job.srcStride + size_t(lo) * 4;
+                };
+                uint16_t* out = tmp.data() + size_t(lo - first) * 4;
+                k.tentColumn(row(2 * y - 1), row(2 * y), row(2 * y + 1), row(2 * y + 2), out, (hi - lo) * 4);
+                // replicate the border pixels where the window leaves the image
+                for (int i = 0; i < lo - first; ++i) {
+                    std::copy_n(out, 4, tmp.data() + 4 * i);
+                }
+                for (int i = hi - first; i < needed; ++i) {
+                    std::copy_n(tmp.data() + size_t(hi - first - 1) * 4, 4, tmp.data() + 4 * i);
+                }
+                k.tentRow(tmp.data(), job.dst + size_t(y) * job.dstStride + size_t(tx) * 4, txEnd - tx);
+            }
+        }
+    }
+}
+
+} // namespace
+
+void downscale2x(const uint8_t* src, size_t srcStride, int srcWidth, int srcHeight,
+                 uint8_t* dst, size_t dstStride, DownscaleFilter filter, int nthreads) {
+    const int dstWidth = srcWidth / 2;
+    const int dstHeight = srcHeight / 2;
+    if (dstWidth <= 0 || dstHeight <= 0) {
+        return;
+    }
+    Job job{src, srcStride, srcWidth, srcHeight, dst, dstStride, dstWidth};
+    auto band = filter == DownscaleFilter::Box ? boxBand : bilinearBand;
+
+    // bands of whole tile rows, at most one per thread
+    int nbands = 1;
+    if (size_t(dstWidth) * dstHeight >= MT_THRESHOLD) {
+        nbands = std::clamp(nthreads, 1, (dstHeight + TILE_H - 1) / TILE_H);
+    }
+    if (nbands == 1) {
+        band(job, 0, dstHeight);
+        return;
+    }
+    int tiles = (dstHeight + TILE_H - 1) / TILE_H;
+    std::vector<std::thread> threads;
+    for (int b = 1; b < nbands; ++b) {
+        int y0 = std::min(dstHeight, (tiles * b / nbands) * TILE_H);
+        int y1 = std::min(dstHeight, (tiles * (b + 1) / nbands) * TILE_H);
+        threads.emplace_back(band, std::cref(job), y0, y1);
+    }
+    // the calling thread takes the first band
+    band(job, 0, std::min(dstHeight, (tiles / nbands) * TILE_H));
+    for (auto& t : threads) {
+        t.join();
+    }
+}
+
+const char* downscaleIsa() {
+    return kernels().isa;
+}
+
+} // namespace pr
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef> // for size_t
+#include <cstdint>
+
+namespace pr {
+
+/**
+ * @brief Filters for the dedicated 2:1 downscaler.
+ * - Box: each destination pixel is the average of its 2x2 source block. Fastest.
+ * - Bilinear: separable tent filter, weights 1 3 3 1 over a 4x4 source neighborhood
+ *   (edges clamped). Smoother, this is what a bilinear smooth scale amounts to at exactly 2:1.
+ */
+enum class DownscaleFilter { Box, Bilinear };
+
+/**
+ * @brief Halves a 32 bits per pixel image in both dimensions.
+ *
+ * Works on any layout with four 8-bit channels (QImage RGB32, ARGB32, ARGB32_Premultiplied...),
+ * channels are filtered independently. The destination has floor(w/2) x floor(h/2) pixels.
+ * Uses AVX2 or SSE2 when the CPU supports it (runtime dispatch), scalar code otherwise.
+ * The work is tiled so that the source rows of a tile stay in cache, and split in horizontal
+ * bands over nthreads threads for very large images.
+ *
+ * @param src first byte of the source image, srcStride bytes per source row.
+ * @param dst first byte of the destination, dstStride bytes per destination row.
+ * @param nthreads max number of threads to use ; small images always use the calling thread only.
+ */
+void downscale2x(const uint8_t* src, size_t srcStride, int srcWidth, int srcHeight,
+                 uint8_t* dst, size_t dstStride, DownscaleFilter filter, int nthreads = 1);
+
+/**
+ * @brief The name of the instruction set used by downscale2x on this machine ("avx2", "sse2" or "scalar").
+ */
+const char* downscaleIsa();
+
+} // namespace pr
@@ -0,0 +1,89 @@
+// ImagePool.cpp
+#include "ImagePool.h"
+#include <algorithm>
+#include <iostream>
+#include <new>
+
+namespace pr {
+
+// 64 bytes : a cache line, and enough for any SIMD load/store we may use on the rows
+static constexpr std::align_val_t BUFFER_ALIGN{64};
+
+ImagePool::ImagePool(size_t maxRetainedBytes) : maxRetained_(maxRetainedBytes) {}
+
+ImagePool::~ImagePool() {
+    for (auto& [key, buffers] : free_) {
+        for (Buffer* b : buffers) {
+            freeBuffer(b);
+        }
+    }
+}
+
+QImage ImagePool::acquire(int width, int height, QImage::Format format) {
+    if (width <= 0 || height <= 0 || format == QImage::Format_Invalid) {
+        return QImage();
+    }
+    // QImage requires 32 bit aligned scanlines
+    const qsizetype bytesPerLine = ((qsizetype(width) * QImage::toPixelFormat(format).bitsPerPixel() + 31) / 32) * 4;
+    const Key key{width, height, int(format)};
+
+    Buffer* buffer = nullptr;
+    {
+        std::unique_lock lock(mtx_);
+        auto it = free_.find(key);
+        if (it != free_.end() && !it->second.empty()) {
+            buffer = it->second.back();
+            it->second.pop_back();
+            stats_.retainedBytes -= buffer->bytes;
+            stats_.reuses++;
+        } else {
+            stats_.allocations++;
+            ownedBytes_ += size_t(bytesPerLine) * height;
+            stats_.peakBytes = std::max(stats_.peakBytes, ownedBytes_);
+        }
+    }
+    if (!buffer) {
+        // allocate outside the critical section
+        size_t bytes = size_t(bytesPerLine) * height;
+        uchar* data = static_cast<uchar*>(::operator new(bytes, BUFFER_ALIGN));
+        buffer = new Buffer{this, key, data, bytes};
+    }
+    return QImage(buffer->data, width, height, bytesPerLine, format, &ImagePool::recycle, buffer);
+}
+
+void ImagePool::recycle(void* info) {
+    Buffer* buffer = static_cast<Buffer*>(info);
+    buffer->pool->release(buffer);
+}
+
+void ImagePool::release(Buffer* buffer) {
+    {
+        std::unique_lock lock(mtx_);
+        if (stats_.retainedBytes + buffer->bytes <= maxRetained_) {
+            free_[buffer->key].push_back(buffer);
+            stats_.retainedBytes += buffer->bytes;
+            return;
+        }
+        stats_.dropped++;
+        ownedBytes_ -= buffer->bytes;
+    }
+    freeBuffer(buffer);
+}
+
+void ImagePool::freeBuffer(Buffer* buffer) {
+    ::operator delete(buffer->data, BUFFER_ALIGN);
+    delete buffer;
+}
+
+ImagePool::Stats ImagePool::stats() const {
+    std::unique_lock lock(mtx_);
+    return stats_;
+}
+
+std::ostream& operator<<(std::ostream& os, const ImagePool::Stats& s) {
+    os << "allocations " << s.allocations << ", reuses " << s.reuses << ", dropped " << s.dropped
+       << ", idle " << s.retainedBytes / (1024 * 1024) << " MB, peak owned " << s.peakBytes / (1024 * 1024) << " MB";
+    return os;
+}
+
+} // namespace pr
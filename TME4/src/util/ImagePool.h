@@ -0,0 +1,76 @@
+#pragma once
+
+#include <QImage>
+#include <cstddef> // for size_t
+#include <iosfwd>  // for std::ostream
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+namespace pr {
+
+/**
+ * @brief A recycling pool of pixel buffers, keyed by (width, height, format).
+ *
+ * Each stage of the pipeline normally gets a freshly malloc'ed full resolution bitmap from Qt,
+ * which is freed a few milliseconds later. The pool keeps these buffers around instead :
+ * acquire() returns a QImage whose pixels live in a pooled buffer, and the buffer goes back
+ * to the pool automatically when the last QImage sharing it is destroyed (we register a
+ * QImageCleanupFunction, so no explicit release is needed, e.g. after saveImage).
+ *
+ * Retained (idle) memory is capped : a returned buffer that would exceed the cap is freed.
+ * The pool is thread safe ; it must outlive all the images it handed out.
+ */
+class ImagePool {
+public:
+    struct Stats {
+        size_t allocations = 0;   // buffers created
+        size_t reuses = 0;        // acquire satisfied from the pool
+        size_t dropped = 0;       // buffers freed on return because of the cap
+        size_t retainedBytes = 0; // idle bytes currently held
+        size_t peakBytes = 0;     // high-water mark of bytes owned (idle + in use)
+
+        friend std::ostream& operator<<(std::ostream& os, const Stats& s);
+    };
+
+    /**
+     * @param maxRetainedBytes cap on the idle memory kept for reuse.
+     */
+    explicit ImagePool(size_t maxRetainedBytes);
+    ~ImagePool();
+
+    ImagePool(const ImagePool&) = delete;
+    ImagePool& operator=(const ImagePool&) = delete;
+
+    /**
+     * @brief Returns an uninitialized image backed by a pooled buffer.
+     * @return a null QImage if the size or format is invalid.
+     */
+    QImage acquire(int width, int height, QImage::Format format);
+
+    Stats stats() const;
+
+private:
+    using Key = std::tuple<int, int, int>; // width, height, format
+
+    struct Buffer {
+        ImagePool* pool;
+        Key key;
+        uchar* data;
+        size_t bytes;
+    };
+
+    // QImageCleanupFunction, invoked by Qt when the last copy of the image dies
+    static void recycle(void* info);
+    void release(Buffer* buffer);
+    static void freeBuffer(Buffer* buffer);
+
+    const size_t maxRetained_;
+    mutable std::mutex mtx_;
+    std::map<Key, std::vector<Buffer*>> free_;
+    Stats stats_;
+    size_t ownedBytes_ = 0;
+};
+
+} // namespace pr
@@ -1,30 +1,208 @@
 // ImageUtils.cpp
 #include "ImageUtils.h"
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 namespace pr {
 
+// suffixes of the formats Qt can read, lower case with the dot, computed once
+static const std::unordered_set<std::string>& imageSuffixes() {
+    static const std::unordered_set<std::string> suffixes = [] {
+        std::unordered_set<std::string> result;
+        for (const auto& fmt : QImageReader::supportedImageFormats()) {
+            result.insert("." + fmt.toLower().toStdString());
+        }
+        return result;
+    }();
+    return suffixes;
+}
+
+static bool isImageFile(const std::filesystem::directory_entry& entry) {
+    std::error_code ec;
+    if (!entry.is_regular_file(ec)) {
+        return false;
+    }
+    std::string ext = entry.path().extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return imageSuffixes().count(ext) != 0;
+}
+
+// ask the kernel to start reading the file in the background
+static void prefetchFile(const std::filesystem::path& file) {
+#if defined(__linux__)
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        (void)posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+        close(fd);
+    }
+#else
+    (void)file; // no portable equivalent, hint ignored
+#endif
+}
+
+// Delivers files to the callback in order, keeping the next "prefetch" files hinted.
+class PrefetchWindow {
+    std::function<void(const std::filesystem::path&)>& callback_;
+    size_t depth_;
+    std::deque<std::filesystem::path> window_;
+public:
+    PrefetchWindow(std::function<void(const std::filesystem::path&)>& callback, int depth)
+        : callback_(callback), depth_(std::max(depth, 0)) {}
+    void add(std::filesystem::path file) {
+        if (depth_ == 0) {
+            callback_(file);
+            return;
+        }
+        prefetchFile(file);
+        window_.push_back(std::move(file));
+        if (window_.size() > depth_) {
+            callback_(window_.front());
+            window_.pop_front();
+        }
+    }
+    void flush() {
+        for (const auto& file : window_) {
+            callback_(file);
+        }
+        window_.clear();
+    }
+};
+
+// Parallel recursive listing : workers share a stack of folders to list and publish the
+// image files they find ; the calling thread consumes them.
+class ParallelScan {
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    std::vector<std::filesystem::path> folders_; // to list
+    size_t pending_ = 0;                         // folders queued or being listed
+    std::deque<std::filesystem::path> found_;    // files not yet delivered
+    bool recursive_;
+
+    void worker() {
+        std::unique_lock lock(mtx_);
+        while (true) {
+            cv_.wait(lock, [this] { return !folders_.empty() || pending_ == 0; });
+            if (folders_.empty()) {
+                return; // pending_ == 0 : everything listed
+            }
+            std::filesystem::path folder = std::move(folders_.back());
+            folders_.pop_back();
+            lock.unlock();
+
+            std::vector<std::filesystem::path> subfolders, files;
+            std::error_code ec;
+            for (std::filesystem::directory_iterator it(folder, std::filesystem::directory_options::skip_permission_denied, ec), end;
+                 !ec && it != end; it.increment(ec)) {
+                const auto& entry = *it;
+                std::error_code tec;
+                if (recursive_ && entry.is_directory(tec) && !entry.is_symlink(tec)) {
+                    subfolders.push_back(entry.path());
+                } else if (isImageFile(entry)) {
+                    files.push_back(entry.path());
+                }
+            }
+            if (ec) {
+                std::cerr << "Could not list folder " << folder << ": " << ec.message() << std::endl;
+            }
+
+            lock.lock();
+            pending_ += subfolders.size();
+            pending_--;
+            for (auto& sub : subfolders) {
+                folders_.push_back(std::move(sub));
+            }
+            for (auto& file : files) {
+                found_.push_back(std::move(file));
+            }
+            cv_.notify_all();
+        }
+    }
+
+public:
+    ParallelScan(const std::filesystem::path& root, bool recursive) : folders_{root}, pending_(1), recursive_(recursive) {}
+
+    void run(int nthreads, PrefetchWindow& out) {
+        std::vector<std::thread> threads;
+        for (int i = 0; i < nthreads; i++) {
+            threads.emplace_back(&ParallelScan::worker, this);
+        }
+        std::unique_lock lock(mtx_);
+        while (true) {
+            cv_.wait(lock, [this] { return !found_.empty() || pending_ == 0; });
+            if (found_.empty()) {
+                break;
+            }
+            std::deque<std::filesystem::path> batch;
+            batch.swap(found_);
+            lock.unlock();
+            // callbacks may block (bounded queues), never hold the lock meanwhile
+            for (auto& file : batch) {
+                out.add(std::move(file));
+            }
+            lock.lock();
+        }
+        lock.unlock();
+        for (auto& t : threads) {
+            t.join();
+        }
+        out.flush();
+    }
+};
+
 void findImageFiles(const std::filesystem::path& inputFolder, std::function<void(const std::filesystem::path&)> callback) {
+    findImageFiles(inputFolder, std::move(callback), ScanOptions{});
+}
+
+void findImageFiles(const std::filesystem::path& inputFolder, std::function<void(const std::filesystem::path&)> callback, const ScanOptions& options) {
     if (!std::filesystem::exists(inputFolder) || !std::filesystem::is_directory(inputFolder)) {
         std::cerr << "Input folder does not exist or is not a directory." << std::endl;
         return;
     }
 
-    auto formats = QImageReader::supportedImageFormats();
-    std::vector<std::string> suffixes;
-    for (const auto& fmt : formats) {
-        suffixes.push_back("." + fmt.toLower().toStdString());
-    }
-
-    for (const auto& entry : std::filesystem::directory_iterator(inputFolder)) {
-        if (entry.is_regular_file()) {
-            std::string ext = entry.path().extension().string();
-            std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
-            if (std::find(suffixes.begin(), suffixes.end(), ext) != suffixes.end()) {
-                callback(entry.path());
+    PrefetchWindow out(callback, options.prefetch);
+    if (!options.recursive && options.threads <= 1) {
+        // simple case, a single flat folder listed by the calling thread
+        for (const auto& entry : std::filesystem::directory_iterator(inputFolder)) {
+            if (isImageFile(entry)) {
+                out.add(entry.path());
             }
         }
+        out.flush();
+        return;
     }
+    ParallelScan scan(inputFolder, options.recursive);
+    scan.run(std::max(options.threads, 1), out);
+}
 
+std::filesystem::path outputPathFor(const std::filesystem::path& inputFolder, const std::filesystem::path& outputFolder, const std::filesystem::path& file) {
+    std::filesystem::path relative = file.lexically_relative(inputFolder);
+    if (relative.empty() || *relative.begin() == "..") {
+        // not below inputFolder : keep the name only
+        return outputFolder / file.filename();
+    }
+    return outputFolder / relative;
+}
+
+// the parent folders of an output file, for the subfolders of a recursive scan
+static bool createParentFolders(const std::filesystem::path& file) {
+    std::error_code ec;
+    std::filesystem::path parent = file.parent_path();
+    if (parent.empty() || std::filesystem::is_directory(parent, ec)) {
+        return true;
+    }
+    std::filesystem::create_directories(parent, ec);
+    if (ec) {
+        std::cerr << "Could not create folder: " << parent << " (" << ec.message() << ")" << std::endl;
+        return false;
+    }
+    return true;
 }
 
 // load image using QImage API
@@ -39,6 +217,36 @@ QImage loadImage(const std::filesystem::path& file) {
     return image;
 }
 
+QImage loadImage(const std::filesystem::path& file, ImagePool* pool) {
+    if (!pool) {
+        return loadImage(file);
+    }
+    // read the header first to know the size and pixel format of the bitmap
+    QImageReader reader(QString::fromStdString(file.string()));
+    QSize size = reader.size();
+    QImage image;
+    if (size.isValid()) {
+        // the decoders reuse the target image when its size and format match
+        // otherwise they reallocate, and the pooled buffer simply goes back to the pool
+        image = pool->acquire(size.width(), size.height(), reader.imageFormat());
+    }
+    if (!reader.read(&image)) {
+        std::cerr << "Could not read image: " << file << std::endl;
+        return QImage();
+    }
+    return image;
+}
+
+size_t estimateImageBytes(const std::filesystem::path& file) {
+    QImageReader reader(QString::fromStdString(file.string()));
+    QSize size = reader.size();
+    if (!size.isValid()) {
+        return 0;
+    }
+    size_t full = size_t(size.width()) * size_t(size.height()) * 4;
+    return full + full / 4;
+}
+
 QImage resizeImage(const QImage& originalImage) {
     if (originalImage.isNull()) {
         return QImage();
@@ -46,14 +254,83 @@ QImage resizeImage(const QImage& originalImage) {
     return originalImage.scaled(originalImage.width() / 2, originalImage.height() / 2, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
 }
 
-void saveImage(const QImage& image, const std::filesystem::path& file) {
+// our SIMD downscaler, into a pooled buffer if available
+static QImage downscaleImage(const QImage& originalImage, ImagePool* pool, DownscaleFilter filter, int nthreads) {
+    QImage source = originalImage;
+    QImage::Format format = source.format();
+    if (format != QImage::Format_RGB32 && format != QImage::Format_ARGB32 && format != QImage::Format_ARGB32_Premultiplied) {
+        // the kernels need 4 bytes per pixel ; JPEG decodes to RGB32 already, so this is rare
+        format = source.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32;
+        source = source.convertToFormat(format);
+    }
+    int width = source.width() / 2;
+    int height = source.height() / 2;
+    if (width == 0 || height == 0) {
+        return QImage();
+    }
+    QImage resized = pool ? pool->acquire(width, height, format) : QImage(width, height, format);
+    downscale2x(source.constBits(), source.bytesPerLine(), source.width(), source.height(),
+                resized.bits(), resized.bytesPerLine(), filter, nthreads);
+    return resized;
+}
+
+QImage resizeImage(const QImage& originalImage, ImagePool* pool, ResizeMethod method, int nthreads) {
+    if (originalImage.isNull()) {
+        return QImage();
+    }
+    if (method == ResizeMethod::Box) {
+        return downscaleImage(originalImage, pool, DownscaleFilter::Box, nthreads);
+    }
+    if (method == ResizeMethod::Bilinear) {
+        return downscaleImage(originalImage, pool, DownscaleFilter::Bilinear, nthreads);
+    }
+    // QImage::scaled allocates its result : with a pool, only the decode buffer is recycled,
+    // so that the pixels do not depend on --pool-mb
+    return resizeImage(originalImage);
+}
+
+bool saveImage(const QImage& image, const std::filesystem::path& file) {
     if (image.isNull()) {
         std::cerr << "Cannot save null image." << std::endl;
-        return;
+        return false;
+    }
+    if (!createParentFolders(file)) {
+        return false;
     }
     if (!image.save(QString::fromStdString(file.string()), "JPG")) {
         std::cerr << "Could not write image: " << file << std::endl;
+        return false;
+    }
+    return true;
+}
+
+ImageSaver::ImageSaver() {
+    buffer_.open(QIODevice::WriteOnly);
+    writer_.setDevice(&buffer_);
+    writer_.setFormat("JPG");
+}
+
+bool ImageSaver::save(const QImage& image, const std::filesystem::path& file) {
+    if (image.isNull()) {
+        std::cerr << "Cannot save null image." << std::endl;
+        return false;
+    }
+    // overwrite from the start : the buffer keeps its capacity, only [0, pos) is this image
+    buffer_.seek(0);
+    if (!writer_.write(image)) {
+        std::cerr << "Could not encode image: " << file << " (" << writer_.errorString().toStdString() << ")" << std::endl;
+        return false;
+    }
+    if (!createParentFolders(file)) {
+        return false;
+    }
+    std::ofstream out(file, std::ios::binary | std::ios::trunc);
+    out.write(buffer_.data().constData(), std::streamsize(buffer_.pos()));
+    if (!out) {
+        std::cerr << "Could not write image: " << file << std::endl;
+        return false;
     }
+    return true;
 }
 
 } // namespace pr
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <QBuffer>
 #include <QImage>
 #include <QImageReader>
+#include <QImageWriter>
 #include <filesystem>
 #include <vector>
 #include <string>
@@ -9,9 +11,32 @@
 #include <cctype>
 #include <iostream>
 #include <functional>
+#include <unordered_set>
+#include "ImagePool.h"
+#include "Downscale.h"
 
 namespace pr {
 
+/**
+ * @brief How resizeImage halves an image.
+ * Qt is QImage::scaled with smooth transformation, the others use our dedicated 2:1
+ * SIMD downscaler (see Downscale.h) on 32 bit pixels.
+ */
+enum class ResizeMethod { Qt, Box, Bilinear };
+
+/**
+ * @brief Options for findImageFiles.
+ * - recursive: also descend into subfolders (symbolic links to folders are not followed).
+ * - threads: number of threads listing folders in parallel (recursive scans only).
+ * - prefetch: number of upcoming files hinted to the kernel (posix_fadvise WILLNEED) before
+ *   the callback sees them, so their reads are already in flight when a reader opens them.
+ */
+struct ScanOptions {
+    bool recursive = false;
+    int threads = 1;
+    int prefetch = 0;
+};
+
 /**
  * @brief Finds image files in the specified folder and calls the callback for each.
  * @param inputFolder The path to the folder to search for image files.
@@ -19,6 +44,26 @@ namespace pr {
  */
 void findImageFiles(const std::filesystem::path& inputFolder, std::function<void(const std::filesystem::path&)> callback);
 
+/**
+ * @brief Finds image files, possibly recursively with parallel listing and read-ahead.
+ * The callback is always invoked from the calling thread, one file at a time ; with several
+ * threads the order of the files is not specified, but prefetching follows the delivery order.
+ * @param inputFolder The path to the folder to search for image files.
+ * @param callback A function to call for each found image file path.
+ * @param options Scan options.
+ */
+void findImageFiles(const std::filesystem::path& inputFolder, std::function<void(const std::filesystem::path&)> callback, const ScanOptions& options);
+
+/**
+ * @brief Where the output of file goes : its path below inputFolder, mirrored under outputFolder,
+ * so that files with the same name in different subfolders of a recursive scan stay apart.
+ * @param inputFolder The root of the scan that found file.
+ * @param outputFolder The root of the outputs.
+ * @param file An input file, found below inputFolder.
+ * @return The output path ; its parent folder may not exist yet (saveImage creates it).
+ */
+std::filesystem::path outputPathFor(const std::filesystem::path& inputFolder, const std::filesystem::path& outputFolder, const std::filesystem::path& file);
+
 /**
  * @brief Loads an image from the specified file.
  * @param file The path to the image file.
@@ -26,6 +71,22 @@ void findImageFiles(const std::filesystem::path& inputFolder, std::function<void
  */
 QImage loadImage(const std::filesystem::path& file);
 
+/**
+ * @brief Loads an image, decoding directly into a buffer taken from the pool.
+ * @param file The path to the image file.
+ * @param pool The buffer pool ; if nullptr, same as loadImage(file).
+ * @return The loaded QImage, its buffer returns to the pool when it is destroyed.
+ */
+QImage loadImage(const std::filesystem::path& file, ImagePool* pool);
+
+/**
+ * @brief Estimates the memory needed to process an image, from its header only (no decoding):
+ * the decoded bitmap at 32 bits per pixel plus its half size copy.
+ * @param file The path to the image file.
+ * @return The estimate in bytes, 0 if the header cannot be read.
+ */
+size_t estimateImageBytes(const std::filesystem::path& file);
+
 /**
  * @brief Resizes the given image to half of its original size in both dimensions.
  * @param originalImage The original image to resize.
@@ -33,11 +94,48 @@ QImage loadImage(const std::filesystem::path& file);
  */
 QImage resizeImage(const QImage& originalImage);
 
+/**
+ * @brief Resizes to half size, writing into a buffer taken from the pool.
+ * Qt always allocates its result (QImage::scaled, the same pixels with or without a pool),
+ * Box and Bilinear write into a pooled buffer.
+ * @param originalImage The original image to resize.
+ * @param pool The buffer pool ; if nullptr, a fresh image is allocated.
+ * @param method The resize algorithm.
+ * @param nthreads Threads the SIMD downscaler may use on very large images (Box/Bilinear only).
+ * @return The resized QImage, its buffer returns to the pool when it is destroyed.
+ */
+QImage resizeImage(const QImage& originalImage, ImagePool* pool, ResizeMethod method = ResizeMethod::Qt, int nthreads = 1);
+
 /**
  * @brief Saves the image to the specified file.
  * @param image The image to save.
- * @param file The path where to save the image.
+ * @param file The path where to save the image, its missing parent folders are created.
+ * @return false if the image could not be written (already reported on std::cerr).
  */
-void saveImage(const QImage& image, const std::filesystem::path& file);
+bool saveImage(const QImage& image, const std::filesystem::path& file);
+
+/**
+ * @brief A JPEG encoder kept alive across images, for a worker that saves many of them.
+ * saveImage pays for a new QImageWriter each time : format plugin lookup, handler creation,
+ * and a growing output buffer. Here the writer and its handler are created once, images are
+ * encoded into an in-memory buffer that keeps its capacity, and each file is written with
+ * a single write. Not thread safe : one per thread.
+ */
+class ImageSaver {
+public:
+    ImageSaver();
+    ImageSaver(const ImageSaver&) = delete;
+    ImageSaver& operator=(const ImageSaver&) = delete;
+
+    /**
+     * @brief Saves the image to the specified file, as saveImage does.
+     * @return false if encoding or writing failed (already reported on std::cerr).
+     */
+    bool save(const QImage& image, const std::filesystem::path& file);
+
+private:
+    QBuffer buffer_;
+    QImageWriter writer_;
+};
 
 } // namespace pr
@@ -0,0 +1,162 @@
+// Manifest.cpp
+#include "Manifest.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace pr {
+
+static const char* const MANIFEST_HEADER = "# pr image resizer manifest v1";
+
+Manifest::Manifest(std::filesystem::path file, size_t checkpoint_every)
+    : file_(std::move(file)), journal_file_(std::filesystem::path(file_) += ".journal"), checkpoint_every_(checkpoint_every) {
+    std::ifstream in(file_);
+    if (in) {
+        std::string line;
+        if (std::getline(in, line) && line == MANIFEST_HEADER) {
+            readEntries(in);
+        } else {
+            std::cerr << "Ignoring manifest with unexpected format: " << file_ << std::endl;
+        }
+    }
+    // the entries of an interrupted run, newer than the manifest
+    std::ifstream journal(journal_file_);
+    if (journal) {
+        readEntries(journal);
+    }
+}
+
+void Manifest::readEntries(std::istream& in) {
+    std::string line;
+    // a line cut short by an interruption has no end of line : it is dropped
+    while (std::getline(in, line) && !in.eof()) {
+        std::istringstream ss(line);
+        Stamp e;
+        std::string path;
+        // the path is the rest of the line, it may contain spaces
+        if (ss >> e.size >> e.mtime && ss.get() == ' ' && std::getline(ss, path) && !path.empty()) {
+            entries_[path] = e;
+        }
+    }
+}
+
+std::string Manifest::key(const std::filesystem::path& input) {
+    std::error_code ec;
+    std::filesystem::path abs = std::filesystem::absolute(input, ec);
+    return (ec ? input : abs).lexically_normal().string();
+}
+
+std::optional<Manifest::Stamp> Manifest::stamp(const std::filesystem::path& input) {
+    std::error_code ec;
+    std::uintmax_t size = std::filesystem::file_size(input, ec);
+    if (ec) {
+        return std::nullopt;
+    }
+    auto in_time = std::filesystem::last_write_time(input, ec);
+    if (ec) {
+        return std::nullopt;
+    }
+    return Stamp{size, int64_t(in_time.time_since_epoch().count())};
+}
+
+bool Manifest::upToDate(const std::filesystem::path& input, const std::filesystem::path& output) {
+    std::error_code ec;
+    auto out_time = std::filesystem::last_write_time(output, ec);
+    if (ec) {
+        return false; // no output yet
+    }
+    std::uintmax_t size = std::filesystem::file_size(input, ec);
+    if (ec) {
+        return false;
+    }
+    auto in_time = std::filesystem::last_write_time(input, ec);
+    if (ec) {
+        return false;
+    }
+    std::string k = key(input);
+    std::unique_lock lock(mtx_);
+    auto it = entries_.find(k);
+    bool done = it != entries_.end()
+        ? it->second.size == size && it->second.mtime == int64_t(in_time.time_since_epoch().count())
+        : out_time >= in_time;
+    if (done) {
+        skipped_++;
+    }
+    return done;
+}
+
+void Manifest::record(const std::filesystem::path& input, const Stamp& stamp) {
+    std::string k = key(input);
+    if (k.find('\n') != std::string::npos) {
+        return; // would break the line format ; such a file is simply processed every time
+    }
+    std::unique_lock lock(mtx_);
+    entries_[k] = stamp;
+    recorded_++;
+    if (!journal_.is_open()) {
+        journal_.open(journal_file_, std::ios::app);
+    }
+    journal_ << stamp.size << " " << stamp.mtime << " " << k << "\n";
+    if (++unflushed_ >= checkpoint_every_ && checkpoint_every_ > 0) {
+        journal_.flush();
+        unflushed_ = 0;
+    }
+}
+
+bool Manifest::save() {
+    std::vector<std::pair<std::string, Stamp>> snapshot;
+    size_t recorded;
+    {
+        std::unique_lock lock(mtx_);
+        snapshot.assign(entries_.begin(), entries_.end());
+        recorded = recorded_;
+        if (journal_.is_open()) {
+            journal_.flush();
+        }
+    }
+    std::filesystem::path tmp = file_;
+    tmp += ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        out << MANIFEST_HEADER << "\n";
+        for (const auto& [path, e] : snapshot) {
+            out << e.size << " " << e.mtime << " " << path << "\n";
+        }
+        out.flush();
+        if (!out) {
+            std::cerr << "Could not write manifest: " << tmp << std::endl;
+            return false;
+        }
+    }
+    // rename is atomic : readers see either the old or the new manifest, never a partial one
+    std::error_code ec;
+    std::filesystem::rename(tmp, file_, ec);
+    if (ec) {
+        std::cerr << "Could not replace manifest " << file_ << ": " << ec.message() << std::endl;
+        return false;
+    }
+    std::unique_lock lock(mtx_);
+    if (recorded_ == recorded) {
+        // every journal entry is in the manifest now ; otherwise the journal is kept for the
+        // entries recorded meanwhile, replaying the others is harmless
+        journal_.close();
+        std::filesystem::remove(journal_file_, ec);
+        unflushed_ = 0;
+    }
+    return true;
+}
+
+size_t Manifest::skipped() const {
+    std::unique_lock lock(mtx_);
+    return skipped_;
+}
+
+size_t Manifest::recorded() const {
+    std::unique_lock lock(mtx_);
+    return recorded_;
+}
+
+} // namespace pr
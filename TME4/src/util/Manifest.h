@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef> // for size_t
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+namespace pr {
+
+/**
+ * @brief Index of the images already processed, for incremental runs.
+ *
+ * For each input file that was successfully converted, the manifest remembers its size and
+ * modification time. On the next run, an input is skipped when its output exists and either
+ * the manifest entry still matches the input, or (no entry, e.g. outputs from an older run)
+ * the output is at least as recent as the input.
+ *
+ * The manifest is a small text file, one "size mtime path" line per input. During a run, new
+ * entries are only appended, in the same format, to a journal next to it (file + ".journal"),
+ * flushed every few hundred entries : recording stays O(1) however large the manifest is. save
+ * compacts once, at the end : the whole manifest is written to a temporary file renamed over the
+ * old one (atomic), then the journal is removed. An interrupted run leaves the old manifest and
+ * its journal, which the next run replays, so it resumes where the previous one stopped.
+ *
+ * upToDate and record can be called concurrently from any thread.
+ */
+class Manifest {
+public:
+    /**
+     * @brief Loads the manifest if the file exists, starts empty otherwise.
+     * @param file The manifest file.
+     * @param checkpoint_every Flush the journal after this many new entries (0 = only on save).
+     */
+    explicit Manifest(std::filesystem::path file, size_t checkpoint_every = 256);
+
+    /**
+     * @brief Tells whether input needs no processing, counting it as skipped if so.
+     * @param input The input image.
+     * @param output The output it would be converted to.
+     */
+    bool upToDate(const std::filesystem::path& input, const std::filesystem::path& output);
+
+    /**
+     * @brief Size and modification time of an input, as recorded in the manifest.
+     */
+    struct Stamp {
+        std::uintmax_t size;
+        int64_t mtime; // ticks of file_time_type, only compared on the same platform
+    };
+
+    /**
+     * @brief The stamp of input, or nothing if it cannot be read. Take it before loading the
+     * input : if the input changes while it is converted, the recorded stamp is the one of the
+     * content that was converted, and the next run sees the change.
+     */
+    static std::optional<Stamp> stamp(const std::filesystem::path& input);
+
+    /**
+     * @brief Records that input has been converted ; call once its output is written.
+     * @param input The input image.
+     * @param stamp Its stamp, taken before it was loaded.
+     */
+    void record(const std::filesystem::path& input, const Stamp& stamp);
+
+    /**
+     * @brief Writes the manifest, atomically, and removes the journal it now contains.
+     * The entries are copied under the lock and written outside of it ; called once, at the end
+     * of the run (two saves at the same time would share the temporary file).
+     * @return false if it could not be written (the previous version and the journal are then left intact).
+     */
+    bool save();
+
+    size_t skipped() const;
+    size_t recorded() const;
+
+private:
+    static std::string key(const std::filesystem::path& input);
+    // adds the "size mtime path" lines of in to entries_, the last one of a path wins
+    void readEntries(std::istream& in);
+
+    const std::filesystem::path file_;
+    const std::filesystem::path journal_file_;
+    const size_t checkpoint_every_;
+    mutable std::mutex mtx_; // protects all the fields below
+    std::unordered_map<std::string, Stamp> entries_;
+    std::ofstream journal_; // opened (append) at the first record
+    size_t skipped_ = 0;
+    size_t recorded_ = 0;
+    size_t unflushed_ = 0;
+};
+
+} // namespace pr
@@ -0,0 +1,178 @@
+// PipelineStats.cpp
+#include "PipelineStats.h"
+#include <algorithm>
+#include <bit>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace pr {
+
+/*****************************************************************************
+ * LatencyHistogram
+ *****************************************************************************/
+
+// values below SUB_COUNT are exact ; above, slot = (exponent, SUB_BITS bits of mantissa)
+int LatencyHistogram::slotOf(uint64_t ns) {
+    if (ns < SUB_COUNT) {
+        return int(ns);
+    }
+    int exponent = 63 - std::countl_zero(ns); // >= SUB_BITS
+    int sub = int((ns >> (exponent - SUB_BITS)) & (SUB_COUNT - 1));
+    return (exponent - SUB_BITS + 1) * SUB_COUNT + sub;
+}
+
+uint64_t LatencyHistogram::upperBound(int slot) {
+    if (slot < SUB_COUNT) {
+        return uint64_t(slot);
+    }
+    int shift = slot / SUB_COUNT - 1; // exponent - SUB_BITS
+    uint64_t lower = uint64_t(SUB_COUNT + slot % SUB_COUNT) << shift;
+    return lower + ((uint64_t(1) << shift) - 1);
+}
+
+void LatencyHistogram::record(uint64_t ns) {
+    slots_[slotOf(ns)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(ns, std::memory_order_relaxed);
+    uint64_t prev = max_.load(std::memory_order_relaxed);
+    while (prev < ns && !max_.compare_exchange_weak(prev, ns, std::memory_order_relaxed)) {
+        // prev reloaded by the failed CAS
+    }
+}
+
+double LatencyHistogram::mean() const {
+    uint64_t n = count();
+    return n == 0 ? 0.0 : double(sum_.load(std::memory_order_relaxed)) / double(n);
+}
+
+uint64_t LatencyHistogram::percentile(double p) const {
+    uint64_t n = count();
+    if (n == 0) {
+        return 0;
+    }
+    uint64_t rank = std::max<uint64_t>(1, uint64_t(p * double(n) + 0.5));
+    uint64_t seen = 0;
+    for (int slot = 0; slot < SLOTS; ++slot) {
+        seen += slots_[slot].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return std::min(upperBound(slot), max());
+        }
+    }
+    return max();
+}
+
+/*****************************************************************************
+ * PipelineStats
+ *****************************************************************************/
+
+const char* PipelineStats::name(Metric m) {
+    switch (m) {
+    case Load: return "load";
+    case Resize: return "resize";
+    case Save: return "save";
+    case QueuePush: return "queue_push";
+    case QueuePop: return "queue_pop";
+    default: return "?";
+    }
+}
+
+PipelineStats::PipelineStats() : start_(std::chrono::steady_clock::now()) {}
+
+PipelineStats::~PipelineStats() {
+    stopReporter();
+}
+
+void PipelineStats::startReporter(std::chrono::milliseconds period, bool print) {
+    if (period.count() <= 0 || reporter_.joinable()) {
+        return;
+    }
+    reporter_ = std::thread(&PipelineStats::reporterLoop, this, period, print);
+}
+
+void PipelineStats::stopReporter() {
+    {
+        std::unique_lock lock(mtx_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if (reporter_.joinable()) {
+        reporter_.join();
+        sample(); // last partial period
+    }
+}
+
+void PipelineStats::reporterLoop(std::chrono::milliseconds period, bool print) {
+    std::unique_lock lock(mtx_);
+    while (!cv_.wait_for(lock, period, [this] { return stop_; })) {
+        lock.unlock();
+        sample();
+        if (print) {
+            std::cout << summaryLine() + "\n";
+        }
+        lock.lock();
+    }
+}
+
+void PipelineStats::sample() {
+    double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    uint64_t saved = histograms_[Save].count();
+    std::unique_lock lock(mtx_);
+    double prev_t = series_.empty() ? 0.0 : series_.back().t_s;
+    uint64_t prev_saved = series_.empty() ? 0 : series_.back().saved;
+    double rate = t > prev_t ? double(saved - prev_saved) / (t - prev_t) : 0.0;
+    series_.push_back({t, saved, rate});
+}
+
+// milliseconds with one decimal, from nanoseconds
+static std::string ms(double ns) {
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(1) << ns / 1e6;
+    return ss.str();
+}
+
+std::string PipelineStats::summaryLine() const {
+    double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    double rate = 0;
+    {
+        std::unique_lock lock(mtx_);
+        if (!series_.empty()) {
+            rate = series_.back().items_per_s;
+        }
+    }
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(1) << "[" << std::setw(6) << t << "s]";
+    for (Metric m : {Load, Resize, Save}) {
+        const auto& h = histograms_[m];
+        ss << " " << name(m) << " " << h.count() << " (p50 " << ms(double(h.percentile(0.5)))
+           << " p99 " << ms(double(h.percentile(0.99))) << " ms)";
+    }
+    ss << " | " << std::setprecision(1) << rate << " img/s";
+    ss << " | wait push " << ms(histograms_[QueuePush].mean()) << " pop " << ms(histograms_[QueuePop].mean()) << " ms avg";
+    return ss.str();
+}
+
+void PipelineStats::writeJson(std::ostream& os) const {
+    auto us = [](double ns) { return ns / 1e3; };
+    os << "{\n  \"histograms_us\": {\n";
+    for (int m = 0; m < NB_METRICS; ++m) {
+        const auto& h = histograms_[m];
+        os << "    \"" << name(Metric(m)) << "\": {\"count\": " << h.count()
+           << ", \"mean\": " << us(h.mean())
+           << ", \"p50\": " << us(double(h.percentile(0.5)))
+           << ", \"p90\": " << us(double(h.percentile(0.9)))
+           << ", \"p99\": " << us(double(h.percentile(0.99)))
+           << ", \"p999\": " << us(double(h.percentile(0.999)))
+           << ", \"max\": " << us(double(h.max())) << "}"
+           << (m + 1 < NB_METRICS ? "," : "") << "\n";
+    }
+    os << "  },\n  \"throughput\": [";
+    std::unique_lock lock(mtx_);
+    for (size_t i = 0; i < series_.size(); ++i) {
+        const auto& s = series_[i];
+        os << (i ? "," : "") << "\n    {\"t_s\": " << s.t_s << ", \"saved\": " << s.saved << ", \"items_per_s\": " << s.items_per_s << "}";
+    }
+    os << "\n  ]\n}\n";
+}
+
+} // namespace pr
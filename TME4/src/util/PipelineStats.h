@@ -0,0 +1,123 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef> // for size_t
+#include <cstdint>
+#include <iosfwd>  // for std::ostream
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace pr {
+
+/**
+ * @brief A latency histogram in the style of HdrHistogram, recording nanoseconds.
+ * Values are bucketed by power of two, each power split in 8 linear sub-buckets : the
+ * relative error on any reported value is below 12.5%, over the whole 1ns..584 years range,
+ * in under 4 KB. record() is lock-free (relaxed atomic increments), so any number of
+ * threads can record concurrently ; readers get a consistent enough snapshot for reporting.
+ */
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BITS = 3;
+    static constexpr int SUB_COUNT = 1 << SUB_BITS;
+    static constexpr int SLOTS = (64 - SUB_BITS + 1) * SUB_COUNT;
+
+    void record(uint64_t ns);
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+    double mean() const;
+    // value (ns) below which a fraction p (0..1) of the recorded values fall
+    uint64_t percentile(double p) const;
+
+private:
+    static int slotOf(uint64_t ns);
+    static uint64_t upperBound(int slot);
+
+    std::array<std::atomic<uint64_t>, SLOTS> slots_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+    std::atomic<uint64_t> max_{0};
+};
+
+/**
+ * @brief Instrumentation of the image pipeline.
+ *
+ * - per stage latency histograms (load, resize, save), whose counts are also the number
+ *   of items each stage processed ;
+ * - time spent blocked on queue push and pop ;
+ * - an items/sec time series of completed (saved) images, sampled by a reporter thread
+ *   that also prints a one line summary periodically ;
+ * - a final JSON dump of all of the above.
+ *
+ * Stages measure with a Scope object, which does nothing when given a null PipelineStats.
+ */
+class PipelineStats {
+public:
+    enum Metric { Load, Resize, Save, QueuePush, QueuePop, NB_METRICS };
+    static const char* name(Metric m);
+
+    PipelineStats();
+    ~PipelineStats();
+
+    void record(Metric m, uint64_t ns) { histograms_[m].record(ns); }
+    const LatencyHistogram& histogram(Metric m) const { return histograms_[m]; }
+
+    // RAII measurement of one operation, a no-op when stats is nullptr
+    class Scope {
+        PipelineStats* stats_;
+        Metric metric_;
+        std::chrono::steady_clock::time_point start_;
+    public:
+        Scope(PipelineStats* stats, Metric metric) : stats_(stats), metric_(metric) {
+            if (stats_) {
+                start_ = std::chrono::steady_clock::now();
+            }
+        }
+        ~Scope() {
+            if (stats_) {
+                auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count();
+                stats_->record(metric_, uint64_t(ns));
+            }
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+    /**
+     * @brief Starts the reporter thread : every period, samples the throughput and,
+     * if print is true, writes a one line summary to std::cout.
+     */
+    void startReporter(std::chrono::milliseconds period, bool print);
+    void stopReporter();
+
+    // one line : items per stage, current rate, p50/p99 latencies, queue waits
+    std::string summaryLine() const;
+    void writeJson(std::ostream& os) const;
+
+private:
+    void reporterLoop(std::chrono::milliseconds period, bool print);
+    void sample();
+
+    struct Sample {
+        double t_s;          // seconds since construction
+        uint64_t saved;      // images completed so far
+        double items_per_s;  // over the last period
+    };
+
+    std::array<LatencyHistogram, NB_METRICS> histograms_;
+    const std::chrono::steady_clock::time_point start_;
+
+    mutable std::mutex mtx_; // protects series_ and the reporter state
+    std::vector<Sample> series_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+    std::thread reporter_;
+};
+
+} // namespace pr
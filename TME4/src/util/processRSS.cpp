@@ -1,8 +1,11 @@
 // process.cpp
 #include "processRSS.h"
+#include <algorithm>
 #include <atomic>
+#include <cstdint> // for SIZE_MAX
 #include <cstdio>
 #include <cstdlib>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
@@ -23,6 +26,7 @@
 #include <mach/task.h>
 #include <mach/task_info.h> // For TASK_VM_INFO
 #elif USE_PROC_MEM
+#include <fcntl.h>
 #include <unistd.h>
 #elif USE_WINDOWS_API
 #include <psapi.h>
@@ -148,4 +152,180 @@ std::ostream &operator<<(std::ostream &os, const MemRSS &m) {
   os << "Resident: " << humanReadable(m.current) << ", Peak: " << humanReadable(m.peak);
   return os;
 }
-} // namespace process
\ No newline at end of file
+
+/*****************************************************************************
+ * RSSSampler
+ *****************************************************************************/
+
+RSSSampler::RSSSampler(std::chrono::milliseconds interval, Probe probe)
+    : interval_(interval.count() > 0 ? interval : std::chrono::milliseconds(1)), probe_(std::move(probe)),
+      start_(std::chrono::steady_clock::now()) {
+#ifdef USE_PROC_MEM
+  statm_fd_ = open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+#endif
+  phases_.push_back({"start", 0.0});
+}
+
+RSSSampler::~RSSSampler() {
+  stop();
+#ifdef USE_PROC_MEM
+  if (statm_fd_ >= 0) {
+    close(statm_fd_);
+  }
+#endif
+}
+
+void RSSSampler::start() {
+  std::unique_lock lock(mtx_);
+  if (thread_.joinable()) {
+    return;
+  }
+  stop_ = false;
+  thread_ = std::thread(&RSSSampler::run, this);
+}
+
+void RSSSampler::stop() {
+  {
+    std::unique_lock lock(mtx_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+    sample(); // state at the very end
+  }
+}
+
+void RSSSampler::mark(const std::string &label) {
+  double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+  {
+    std::unique_lock lock(mtx_);
+    phases_.push_back({label, t});
+  }
+  sample();
+}
+
+void RSSSampler::run() {
+  std::unique_lock lock(mtx_);
+  while (!stop_) {
+    lock.unlock();
+    sample();
+    lock.lock();
+    cv_.wait_for(lock, interval_, [this] { return stop_; });
+  }
+}
+
+void RSSSampler::sample() {
+  size_t rss = 0;
+  size_t data = 0;
+#ifdef USE_PROC_MEM
+  if (statm_fd_ >= 0) {
+    // size resident shared text lib data dt, in pages ; the fd stays open, pread rewinds
+    static const size_t page = size_t(sysconf(_SC_PAGESIZE));
+    char buf[128];
+    ssize_t n = pread(statm_fd_, buf, sizeof(buf) - 1, 0);
+    if (n > 0) {
+      buf[n] = '\0';
+      unsigned long size_p = 0, rss_p = 0, shared_p = 0, text_p = 0, lib_p = 0, data_p = 0;
+      if (sscanf(buf, "%lu %lu %lu %lu %lu %lu", &size_p, &rss_p, &shared_p, &text_p, &lib_p, &data_p) == 6) {
+        rss = rss_p * page;
+        data = data_p * page;
+      }
+    }
+  } else {
+    rss = getResidentMemory().current;
+  }
+#else
+  rss = getResidentMemory().current;
+#endif
+  double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+  // the probe may take locks of its own, call it outside ours
+  std::string note = probe_ ? probe_() : std::string();
+  std::unique_lock lock(mtx_);
+  samples_.push_back({t, rss, data, phases_.size() - 1, std::move(note)});
+}
+
+std::vector<RSSSampler::Sample> RSSSampler::samples() const {
+  std::unique_lock lock(mtx_);
+  return samples_;
+}
+
+std::vector<RSSSampler::Phase> RSSSampler::phases() const {
+  std::unique_lock lock(mtx_);
+  return phases_;
+}
+
+void RSSSampler::report(std::ostream &os) const {
+  std::vector<Sample> samples = this->samples();
+  std::vector<Phase> phases = this->phases();
+  if (samples.empty()) {
+    os << "Memory timeline: no samples" << std::endl;
+    return;
+  }
+  size_t peak = 0;
+  for (size_t i = 1; i < samples.size(); ++i) {
+    if (samples[i].rss > samples[peak].rss) {
+      peak = i;
+    }
+  }
+  const Sample &p = samples[peak];
+  // contiguous span around the peak where the RSS stays within 10% of it
+  size_t threshold = p.rss - p.rss / 10;
+  size_t first = peak, last = peak;
+  while (first > 0 && samples[first - 1].rss >= threshold) {
+    --first;
+  }
+  while (last + 1 < samples.size() && samples[last + 1].rss >= threshold) {
+    ++last;
+  }
+  std::stringstream ss;
+  ss << fixed << setprecision(3);
+  ss << "Memory timeline: " << samples.size() << " samples, interval " << interval_.count() << " ms" << endl;
+  ss << "  peak RSS " << humanReadable(p.rss) << " at " << p.t_s << "s in phase '" << phases[p.phase].label << "'";
+  if (!p.note.empty()) {
+    ss << " (" << p.note << ")";
+  }
+  ss << endl;
+  ss << "  above 90% of peak from " << samples[first].t_s << "s to " << samples[last].t_s << "s";
+  if (samples[first].phase != samples[last].phase) {
+    ss << " (phases '" << phases[samples[first].phase].label << "' to '" << phases[samples[last].phase].label << "')";
+  }
+  ss << endl;
+  for (size_t ph = 0; ph < phases.size(); ++ph) {
+    size_t n = 0, lo = SIZE_MAX, hi = 0;
+    double sum = 0;
+    for (const Sample &s : samples) {
+      if (s.phase == ph) {
+        ++n;
+        lo = std::min(lo, s.rss);
+        hi = std::max(hi, s.rss);
+        sum += double(s.rss);
+      }
+    }
+    if (n == 0) {
+      continue;
+    }
+    double end = ph + 1 < phases.size() ? phases[ph + 1].start_s : samples.back().t_s;
+    ss << "  " << left << setw(16) << phases[ph].label << right << " " << setw(9) << end - phases[ph].start_s << "s"
+       << "  min " << humanReadable(lo) << ", avg " << humanReadable(size_t(sum / double(n))) << ", max " << humanReadable(hi)
+       << endl;
+  }
+  os << ss.str();
+}
+
+bool RSSSampler::writeCsv(const std::string &path) const {
+  std::ofstream out(path);
+  if (!out) {
+    return false;
+  }
+  std::vector<Sample> samples = this->samples();
+  std::vector<Phase> phases = this->phases();
+  out << "t_s,rss_bytes,data_bytes,phase,note\n";
+  out << fixed << setprecision(4);
+  for (const Sample &s : samples) {
+    out << s.t_s << "," << s.rss << "," << s.data << "," << phases[s.phase].label << ",\"" << s.note << "\"\n";
+  }
+  return bool(out);
+}
+
+} // namespace process
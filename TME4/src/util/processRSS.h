@@ -1,8 +1,15 @@
 // process.hpp
 #pragma once
 
+#include <chrono>
+#include <condition_variable>
 #include <cstddef> // for size_t
+#include <functional>
 #include <iosfwd> // for std::ostream
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace process {
 
@@ -35,4 +42,84 @@ struct MemRSS {
  */
 MemRSS getResidentMemory();
 
-} // namespace process
\ No newline at end of file
+/**
+ * Background sampler of the process memory, building a timeline of the RSS to correlate
+ * memory spikes with what the program was doing at the time.
+ *
+ * A thread wakes up every interval and records the resident size and the data segment size
+ * (heap + stacks, virtual). On Linux it reads /proc/self/statm through a file descriptor
+ * opened once, with a single pread per sample : a sample costs a couple of microseconds,
+ * so intervals down to a millisecond are reasonable. Elsewhere it falls back on
+ * getResidentMemory() (data is then reported as 0).
+ *
+ * The program labels its phases with mark() ; each sample is attributed to the current
+ * phase. An optional probe is called at each sample, its result is stored with the sample
+ * (e.g. progress counters of a pipeline). report() then gives the peak, the phase it
+ * occurred in, the span during which the RSS stayed close to the peak, and a per phase
+ * summary. The full timeline can be written as CSV.
+ * Usage example:
+ * \code
+ * RSSSampler sampler(std::chrono::milliseconds(10));
+ * sampler.start();
+ * sampler.mark("load");
+ * ...
+ * sampler.mark("compute");
+ * ...
+ * sampler.stop();
+ * sampler.report(std::cout);
+ * sampler.writeCsv("memory.csv");
+ * \endcode
+ */
+class RSSSampler {
+public:
+    struct Sample {
+        double t_s;        // seconds since construction
+        size_t rss;        // resident bytes
+        size_t data;       // data segment bytes (heap + stacks), 0 if unknown
+        size_t phase;      // index in phases()
+        std::string note;  // result of the probe, if any
+    };
+    struct Phase {
+        std::string label;
+        double start_s;
+    };
+    using Probe = std::function<std::string()>;
+
+    explicit RSSSampler(std::chrono::milliseconds interval, Probe probe = nullptr);
+    ~RSSSampler(); // stops the sampling thread
+    RSSSampler(const RSSSampler&) = delete;
+    RSSSampler& operator=(const RSSSampler&) = delete;
+
+    void start();
+    // takes a last sample, then joins the sampling thread
+    void stop();
+    // starts a new phase, and samples right away so that short phases are not missed
+    void mark(const std::string& label);
+
+    // copies, safe to call while sampling
+    std::vector<Sample> samples() const;
+    std::vector<Phase> phases() const;
+
+    // peak, peak phase, span above 90% of the peak, and per phase min/avg/max
+    void report(std::ostream& os) const;
+    // t_s,rss_bytes,data_bytes,phase,"note" ; returns false if the file cannot be written
+    bool writeCsv(const std::string& path) const;
+
+private:
+    void run();
+    void sample();
+
+    const std::chrono::milliseconds interval_;
+    const Probe probe_;
+    const std::chrono::steady_clock::time_point start_;
+    int statm_fd_ = -1; // Linux only, kept open between samples
+
+    mutable std::mutex mtx_; // protects everything below
+    std::vector<Sample> samples_;
+    std::vector<Phase> phases_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+    std::thread thread_;
+};
+
+} // namespace process
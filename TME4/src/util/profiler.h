@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <iosfwd> // for std::ostream
+#include <string>
+
+namespace pr {
+namespace profile {
+
+/**
+ * A scoped profiler with named, nestable zones measuring both wall clock and thread CPU time
+ * in nanoseconds (the CPU time comes from thread_timer::threadCpuNs).
+ *
+ * Each thread records into its own buffer, without any lock or atomic ; the nesting is
+ * tracked with a thread-local stack of open zones. Buffers are kept after their thread exits.
+ * They give
+ * - a flat profile : per zone path (e.g. "treatImage/load"), number of calls, total and
+ *   self wall time (self = total minus nested zones), and CPU time. Summed per path as the
+ *   zones close, so it costs no memory per call, and merged across threads at the end ;
+ * - a Chrome trace-event JSON file, viewable in chrome://tracing or https://ui.perfetto.dev,
+ *   of the first million zones of each thread (later ones are counted, not traced)
+ *
+ * Profiling is off by default : a Zone then costs one relaxed atomic load.
+ * Zone names must outlive the profiler, typically string literals.
+ * Usage example:
+ * \code
+ * pr::profile::enable();
+ * void worker() {
+ *   PR_PROFILE_ZONE("worker");
+ *   for (...) {
+ *     PR_PROFILE_ZONE("step"); // nested : reported as "worker/step"
+ *     ...
+ *   }
+ * }
+ * // after all profiled threads have been joined :
+ * pr::profile::report(std::cout);
+ * pr::profile::writeChromeTrace("trace.json");
+ * \endcode
+ */
+
+// start recording zones (from now on)
+void enable();
+bool enabled();
+
+// flat profile of everything recorded so far ; call once the profiled threads are joined
+void report(std::ostream& os);
+// Chrome trace-event format ; returns false if the file cannot be written
+bool writeChromeTrace(const std::string& path);
+
+class Zone {
+    int index_; // in the thread buffer, -1 if profiling is disabled
+public:
+    explicit Zone(const char* name);
+    ~Zone();
+    Zone(const Zone&) = delete;
+    Zone& operator=(const Zone&) = delete;
+};
+
+} // namespace profile
+} // namespace pr
+
+#define PR_PROFILE_CONCAT_(a, b) a##b
+#define PR_PROFILE_CONCAT(a, b) PR_PROFILE_CONCAT_(a, b)
+// opens a zone until the end of the enclosing block
+#define PR_PROFILE_ZONE(name) pr::profile::Zone PR_PROFILE_CONCAT(pr_profile_zone_, __LINE__)(name)
@@ -1,4 +1,7 @@
+#pragma once
+
 #include <cstddef> // for size_t
+#include <cstdint> // for uint64_t
 #include <iostream>
 #include <atomic>
 #ifdef _WIN32
@@ -26,6 +29,8 @@ namespace pr {
  * across all timer instances. Each call to getElapsedms contributes its elapsed time to the global total.
  * Use reset() to restart timing for loops or repeated measurements. 
  * Do not nest timers in the same thread for this metric to be accurate.
+ * For nested measurements, use the nanosecond accessors threadCpuNs/getElapsedns, which do not
+ * feed the global total, or the scoped zones of profiler.h built on them.
  * Example usage:
  * \code
  * void someThreadFunction() {
@@ -52,6 +57,30 @@ public:
   static size_t getTotalCpuTimeMs() {
     return total_cpu_time_ms.load(std::memory_order_relaxed);
   }
+  /**
+   * Returns the CPU time (user + system) consumed so far by the calling thread, in nanoseconds
+   * (Windows resolution is 100ns). Does not contribute to the global total. Returns 0 on error.
+   */
+  static uint64_t threadCpuNs() {
+#ifdef _WIN32
+    FILETIME creation, exit_time, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit_time, &kernel, &user)) {
+      return 0;
+    }
+    ULARGE_INTEGER k, u;
+    k.LowPart = kernel.dwLowDateTime;
+    k.HighPart = kernel.dwHighDateTime;
+    u.LowPart = user.dwLowDateTime;
+    u.HighPart = user.dwHighDateTime;
+    return static_cast<uint64_t>(k.QuadPart + u.QuadPart) * 100;
+#else
+    timespec now;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) != 0) {
+      return 0;
+    }
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + static_cast<uint64_t>(now.tv_nsec);
+#endif
+  }
   void reset() {
 #ifdef _WIN32
     FILETIME creation, exit_time;
@@ -111,6 +140,24 @@ public:
     total_cpu_time_ms.fetch_add(elapsed, std::memory_order_relaxed);
     return elapsed;
   }
+  /**
+   * Returns the CPU time in nanoseconds for the current thread since the creation of this
+   * timer instance (or last reset). Unlike getElapsedms, does not contribute to the global total.
+   */
+  uint64_t getElapsedns() const {
+#ifdef _WIN32
+    ULARGE_INTEGER k_start, u_start;
+    k_start.LowPart = kernel_start.dwLowDateTime;
+    k_start.HighPart = kernel_start.dwHighDateTime;
+    u_start.LowPart = user_start.dwLowDateTime;
+    u_start.HighPart = user_start.dwHighDateTime;
+    uint64_t start = static_cast<uint64_t>(k_start.QuadPart + u_start.QuadPart) * 100;
+#else
+    uint64_t start = static_cast<uint64_t>(start_time.tv_sec) * 1000000000ULL + static_cast<uint64_t>(start_time.tv_nsec);
+#endif
+    uint64_t now = threadCpuNs();
+    return now > start ? now - start : 0;
+  }
   friend std::ostream &operator<<(std::ostream &os, const thread_timer &t) {
     os << t.getElapsedms();
     return os;
@@ -0,0 +1,46 @@
+#!/bin/bash
+
+# Script to measure the effect of the BVH as the number of spheres grows
+#
+# Usage: ./measureSpheres.sh [EXE] [MODE] [NBTHREAD]
+#   - EXE: Path to the TME5 executable (default: ./build-release/TME5)
+#   - MODE: Rendering mode (default: sequential)
+#   - NBTHREAD: Number of threads for the threaded modes (default: 4)
+#
+# Invocation example:
+#   ./measureSpheres.sh ./build-release/TME5 PoolTile 8 > spheres.txt
+#
+# Description:
+#   Renders a 400x300 image for sphere counts from 250 to 1M, with the BVH (--accel bvh)
+#   and with the linear scan over every sphere (--accel none).
+#   The linear scan is quadratic in practice (pixels x spheres) : it is skipped above
+#   LINEAR_MAX spheres, where a single run would take minutes.
+#   Output is the program output, "BVH:" line (nodes, depth, build time) and "Total time".
+#
+# Adaptation:
+#   - Modify SPHERES for other counts, LINEAR_MAX to run the linear scan further.
+#   - Change WIDTH and HEIGHT for another resolution.
+
+EXE="${1:-./build-release/TME5}"
+MODE="${2:-sequential}"
+NBTHREAD="${3:-4}"
+
+SPHERES=(250 1000 10000 100000 1000000)
+LINEAR_MAX=10000
+WIDTH=400
+HEIGHT=300
+
+echo "Starting sphere count measurements..."
+
+for n in "${SPHERES[@]}"; do
+    for accel in bvh none; do
+        if [ "$accel" = "none" ] && [ "$n" -gt "$LINEAR_MAX" ]; then
+            continue
+        fi
+        echo "Testing $n spheres with accel $accel"
+        $EXE -W $WIDTH -H $HEIGHT -s $n -m $MODE -n $NBTHREAD --accel $accel -o /dev/null
+        echo "--------------------------------"
+    done
+done
+
+echo "All tests completed."
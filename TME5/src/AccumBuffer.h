@@ -0,0 +1,121 @@
+#pragma once
+
+#include "Color.h"
+#include "Image.h"
+#include "Simd.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace pr {
+
+// une couleur lineaire en float, 0 noir, 1 pleine intensite par composante ; les sommes
+// (lumieres, echantillons) depassent 1 sans saturer, la saturation n'a lieu qu'a la
+// quantification
+struct Radiance {
+	float r = 0, g = 0, b = 0;
+
+	Radiance() = default;
+	Radiance(float r, float g, float b) : r(r), g(g), b(b) {}
+	explicit Radiance(const Color & c) : r(c.getR() / 255.0f), g(c.getG() / 255.0f), b(c.getB() / 255.0f) {}
+
+	Radiance operator*(float k) const { return Radiance(r * k, g * k, b * k); }
+	Radiance & operator+=(const Radiance & o) {
+		r += o.r;
+		g += o.g;
+		b += o.b;
+		return *this;
+	}
+};
+
+// Image de travail en Radiance, en structure de tableaux : un tableau par composante, pour
+// que la quantification traite 8 pixels par instruction.
+// Le rendu y accumule en float (pas d'arrondi a chaque somme comme avec Color) ; resolve
+// quantifie une seule fois vers les octets BGR d'une Image, au moment de l'exporter.
+class AccumBuffer {
+	size_t width_;
+	size_t height_;
+	std::vector<float> r_, g_, b_;
+
+public:
+	AccumBuffer(size_t width, size_t height, const Radiance & fill = Radiance())
+		: width_(width), height_(height), r_(width * height, fill.r), g_(width * height, fill.g), b_(width * height, fill.b) {}
+
+	size_t width() const { return width_; }
+	size_t height() const { return height_; }
+
+	void set(size_t x, size_t y, const Radiance & c) {
+		size_t i = y * width_ + x;
+		r_[i] = c.r;
+		g_[i] = c.g;
+		b_[i] = c.b;
+	}
+	Radiance get(size_t x, size_t y) const {
+		size_t i = y * width_ + x;
+		return Radiance(r_[i], g_[i], b_[i]);
+	}
+
+	// quantifie tout le buffer vers img, de meme taille
+	void resolve(Image & img) const {
+		resolveRows(0, height_, &img.pixel(0, 0));
+	}
+
+	// quantifie les lignes [y0, y1) vers out, (y1 - y0) * width Colors
+	void resolveRows(size_t y0, size_t y1, Color * out) const {
+		const size_t first = y0 * width_;
+		const size_t n = (y1 - y0) * width_;
+		// par blocs : les trois composantes quantifiees, puis entrelacees en BGR
+		constexpr size_t BLOCK = 256;
+		unsigned char qr[BLOCK], qg[BLOCK], qb[BLOCK];
+		for (size_t i = 0; i < n; i += BLOCK) {
+			size_t m = std::min(BLOCK, n - i);
+			quantize(&r_[first + i], qr, m);
+			quantize(&g_[first + i], qg, m);
+			quantize(&b_[first + i], qb, m);
+			for (size_t k = 0; k < m; k++) {
+				out[i + k] = Color(qr[k], qg[k], qb[k]);
+			}
+		}
+	}
+
+	// une composante : sature a [0, 1], puis arrondi a l'entier le plus proche sur 0..255
+	static unsigned char quantize(float v) {
+		float c = v > 0.0f ? (v < 1.0f ? v : 1.0f) : 0.0f; // NaN -> 0
+		return (unsigned char)(int(c * 255.0f + 0.5f));
+	}
+
+	// n composantes ; AVX2 si disponible, meme resultat que la version scalaire
+	static void quantize(const float * in, unsigned char * out, size_t n) {
+		size_t i = 0;
+#if PR_SIMD_AVX2
+		if (cpuHasAVX2()) {
+			i = quantizeAVX2(in, out, n);
+		}
+#endif
+		for (; i < n; i++) {
+			out[i] = quantize(in[i]);
+		}
+	}
+
+private:
+#if PR_SIMD_AVX2
+	// 8 composantes par iteration ; rend le nombre traite (multiple de 8)
+	PR_TARGET_AVX2 static size_t quantizeAVX2(const float * in, unsigned char * out, size_t n) {
+		const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+		const __m256 scale = _mm256_set1_ps(255.0f), half = _mm256_set1_ps(0.5f);
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8) {
+			// max(v, 0) puis min(., 1) : les memes choix que quantize, NaN compris
+			__m256 v = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(in + i), zero), one);
+			__m256i q = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(v, scale), half));
+			// 8 x int32 -> 8 x uint16 -> 8 octets
+			__m128i w = _mm_packus_epi32(_mm256_castsi256_si128(q), _mm256_extracti128_si256(q, 1));
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(w, w));
+		}
+		return i;
+	}
+#endif
+};
+
+} /* namespace pr */
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "CameraPath.h"
+#include "Image.h"
+#include "Pool.h"
+#include "Renderer.h"
+#include "Scene.h"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace pr {
+
+// Renders the frames of a camera path over one scene, whose spheres and BVH are shared by all
+// frames : only the camera changes (Renderer::setCamera).
+//
+// All frames share one Pool. Up to inflight frames render at the same time, each as a task
+// whose rows are spread over the pool with parallel_for : when a frame has fewer rows left
+// than there are threads (its tail, or a small frame), the idle threads take rows of the other
+// frames in flight. A finished frame is handed to a writer thread, which saves it while the
+// next frames render. The images are recycled : inflight + 1 of them exist at any time.
+// The calling thread submits the frames and helps render them (Future::get) : the pool has
+// nbthread - 1 workers, so nbthread threads render in all.
+class Animation {
+public:
+    struct Options {
+        int frames = 1;
+        int nbthread = 1;
+        // frames rendered at the same time ; 0 : chosen from the threads and the frame height
+        int inflight = 0;
+    };
+
+    // a frame keeps about one thread busy per ROWS_PER_THREAD rows
+    static constexpr int ROWS_PER_THREAD = 16;
+
+    static int autoInflight(int nbthread, int height, int frames) {
+        // one more frame than needed to fill the threads, to overlap the tail of each frame
+        int filling = (nbthread * ROWS_PER_THREAD + height - 1) / height;
+        return std::clamp(filling + (nbthread > 1 ? 1 : 0), 1, std::max(frames, 1));
+    }
+
+    // renders the frames of path, frame f being saved to pathOf(f) ; false if a write failed.
+    // base gives the rendering settings (packets), the camera of each frame comes from path.
+    static bool render(const Scene& scene, const CameraPath& path, const Renderer& base, const Options& opts,
+                       const std::function<std::string(int)>& pathOf) {
+        const int w = scene.getWidth();
+        const int h = scene.getHeight();
+        const int inflight = opts.inflight > 0 ? std::min(opts.inflight, opts.frames) : autoInflight(opts.nbthread, h, opts.frames);
+
+        std::vector<std::unique_ptr<Image>> images;
+        std::vector<int> freeSlots;
+        for (int i = 0; i < inflight + 1; i++) {
+            images.push_back(std::make_unique<Image>(w, h));
+            freeSlots.push_back(i);
+        }
+        std::mutex m;
+        std::condition_variable cv;
+        std::deque<std::pair<int, int>> toWrite; // (frame, slot)
+        bool rendered = false; // every frame has been handed to the writer
+        bool ok = true;
+
+        std::thread writer([&] {
+            std::unique_lock<std::mutex> lock(m);
+            for (;;) {
+                cv.wait(lock, [&] { return !toWrite.empty() || rendered; });
+                if (toWrite.empty()) {
+                    return;
+                }
+                auto [frame, slot] = toWrite.front();
+                toWrite.pop_front();
+                lock.unlock();
+                bool written = images[slot]->exportToBMP(pathOf(frame).c_str());
+                lock.lock();
+                ok = ok && written;
+                freeSlots.push_back(slot);
+                cv.notify_all();
+            }
+        });
+
+        Pool pool(2 * opts.nbthread + 16);
+        pool.start(std::max(opts.nbthread - 1, 0));
+        std::vector<Future<void>> frames;
+        frames.reserve(opts.frames);
+        size_t done = 0; // frames[0, done) are rendered
+        for (int f = 0; f < opts.frames; f++) {
+            int slot;
+            for (;;) {
+                std::unique_lock<std::mutex> lock(m);
+                if (!freeSlots.empty()) {
+                    slot = freeSlots.back();
+                    freeSlots.pop_back();
+                    break;
+                }
+                if (done == frames.size()) {
+                    // every slot is being written : only the writer can free one
+                    cv.wait(lock, [&] { return !freeSlots.empty(); });
+                    continue;
+                }
+                // every slot is taken : help render the oldest frame rather than sleep
+                lock.unlock();
+                frames[done++].get();
+            }
+            frames.push_back(pool.async([&, f, slot] {
+                Camera camera = path.camera(f, opts.frames, w, h);
+                Renderer renderer(base);
+                renderer.setCamera(&camera);
+                Image& img = *images[slot];
+                pool.parallel_for(0, size_t(h), 1, [&](size_t y) {
+                    // the image is recycled : clear the row to the background first
+                    std::fill(&img.pixel(0, y), &img.pixel(0, y) + w, Color());
+                    renderer.renderRows(scene, img, int(y), int(y) + 1);
+                });
+                std::lock_guard<std::mutex> lock(m);
+                toWrite.emplace_back(f, slot);
+                cv.notify_all();
+            }));
+        }
+        for (; done < frames.size(); done++) {
+            frames[done].get();
+        }
+        pool.stop();
+        {
+            std::lock_guard<std::mutex> lock(m);
+            rendered = true;
+            cv.notify_all();
+        }
+        writer.join();
+        return ok;
+    }
+};
+
+} // namespace pr
@@ -0,0 +1,176 @@
+#pragma once
+
+#include "Color.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <vector>
+
+namespace pr {
+
+// Writes a 24 bit BMP file, by bands of rows, in any order.
+// The size of the file is known from the start (header, then rows padded to 4 bytes, stored
+// bottom-up) : each band is written at its own offset with pwritev, one system call for up to
+// IOV_MAX rows (and their padding) taken directly from the caller's pixels, with no copy nor
+// stdio buffer. Writing the bands bottom-up, as Renderer::renderStreaming does, fills the
+// file sequentially.
+// A pipe or a terminal (e.g. -o /dev/stdout | ...) has no offsets : the rows then go through
+// writev, and the bands must come in file order (bottom-up), which is what exportToBMP and
+// renderStreaming do ; a band out of order is an error.
+class BMPWriter {
+    int fd_ = -1;
+    size_t width_;
+    size_t height_;
+    size_t rowSize_;
+    bool ok_ = false;
+    // false for a pipe, a FIFO or a character device : sequential writes only
+    bool seekable_ = true;
+    // offset of the next byte written, when not seekable
+    off_t next_ = 0;
+
+    static constexpr size_t HEADER_SIZE = 14 + 40;
+    static constexpr size_t MAX_IOV = 1024; // IOV_MAX on Linux
+
+public:
+    BMPWriter(const char* path, size_t width, size_t height)
+        : width_(width), height_(height), rowSize_(((3 * width + 3) / 4) * 4) {
+        fd_ = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd_ < 0) {
+            return;
+        }
+        const size_t pixel_data_size = rowSize_ * height_;
+
+        // Packed structs for BMP headers to ensure no padding
+        #pragma pack(push, 1)
+        struct BMPFileHeader {
+            char bm[2] = {'B', 'M'};
+            uint32_t file_size;
+            uint32_t reserved = 0;
+            uint32_t data_offset = 54;
+        };
+        struct DIBHeader {
+            uint32_t header_size = 40;
+            int32_t width, height;
+            uint16_t planes = 1, bpp = 24;
+            uint32_t compression = 0, image_size;
+            int32_t res_x = 0, res_y = 0;
+            uint32_t colors = 0, important = 0;
+        };
+        #pragma pack(pop)
+
+        // Compile-time asserts to ensure correct struct sizes (no padding)
+        static_assert(sizeof(BMPFileHeader) == 14, "BMPFileHeader must be 14 bytes");
+        static_assert(sizeof(DIBHeader) == 40, "DIBHeader must be 40 bytes");
+
+        BMPFileHeader fh;
+        fh.file_size = static_cast<uint32_t>(HEADER_SIZE + pixel_data_size);
+        DIBHeader dib;
+        dib.width = static_cast<int32_t>(width_);
+        dib.height = static_cast<int32_t>(height_);
+        dib.image_size = static_cast<uint32_t>(pixel_data_size);
+
+        struct stat st;
+        if (::fstat(fd_, &st) != 0) {
+            return;
+        }
+        seekable_ = S_ISREG(st.st_mode) || S_ISBLK(st.st_mode);
+        std::vector<iovec> iov = {{&fh, sizeof(fh)}, {&dib, sizeof(dib)}};
+        ok_ = writeAll(0, iov, HEADER_SIZE);
+        // the whole file at once : the bands can then come in any order. Only for a regular
+        // file : a device or a pipe (e.g. /dev/null) has no size to set
+        if (ok_ && S_ISREG(st.st_mode)) {
+            ok_ = ::ftruncate(fd_, off_t(HEADER_SIZE + pixel_data_size)) == 0;
+        }
+    }
+
+    BMPWriter(const BMPWriter&) = delete;
+    BMPWriter& operator=(const BMPWriter&) = delete;
+
+    ~BMPWriter() {
+        close();
+    }
+
+    // false if the file could not be created, or a write failed
+    bool ok() const { return ok_; }
+
+    // the rows [y0, y0 + n) of the image, y from the top as in Image : n * width pixels,
+    // row after row
+    bool writeRows(size_t y0, size_t n, const Color* rows) {
+        if (!ok_ || y0 + n > height_) {
+            return ok_ = false;
+        }
+        static const unsigned char padding[3] = {0, 0, 0};
+        const size_t pixelBytes = 3 * width_;
+        const size_t padBytes = rowSize_ - pixelBytes;
+        std::vector<iovec> iov;
+        iov.reserve(MAX_IOV);
+        // bottom-up : the last row of the band comes first in the file
+        size_t y = y0 + n;
+        while (y > y0 && ok_) {
+            const off_t offset = off_t(HEADER_SIZE + (height_ - y) * rowSize_);
+            size_t bytes = 0;
+            iov.clear();
+            while (y > y0 && iov.size() + 2 <= MAX_IOV) {
+                --y;
+                iov.push_back({const_cast<Color*>(rows + (y - y0) * width_), pixelBytes});
+                bytes += pixelBytes;
+                if (padBytes > 0) {
+                    iov.push_back({const_cast<unsigned char*>(padding), padBytes});
+                    bytes += padBytes;
+                }
+            }
+            ok_ = writeAll(offset, iov, bytes);
+        }
+        return ok_;
+    }
+
+    // closes the file, false if something failed
+    bool close() {
+        if (fd_ >= 0) {
+            ok_ = (::close(fd_) == 0) && ok_;
+            fd_ = -1;
+        }
+        return ok_;
+    }
+
+private:
+    // pwritev (writev if not seekable, at the current end only) may write less than asked, or
+    // be interrupted by a signal : continue where it stopped
+    bool writeAll(off_t offset, std::vector<iovec>& iov, size_t bytes) {
+        if (!seekable_) {
+            if (offset != next_) {
+                return false;
+            }
+            next_ += off_t(bytes);
+        }
+        size_t first = 0;
+        while (bytes > 0) {
+            ssize_t w = seekable_ ? ::pwritev(fd_, iov.data() + first, int(iov.size() - first), offset)
+                                  : ::writev(fd_, iov.data() + first, int(iov.size() - first));
+            if (w < 0 && errno == EINTR) {
+                continue;
+            }
+            if (w <= 0) {
+                return false;
+            }
+            bytes -= size_t(w);
+            offset += w;
+            while (w > 0 && size_t(w) >= iov[first].iov_len) {
+                w -= ssize_t(iov[first].iov_len);
+                ++first;
+            }
+            if (w > 0) {
+                iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + w;
+                iov[first].iov_len -= size_t(w);
+            }
+        }
+        return true;
+    }
+};
+
+} /* namespace pr */
@@ -0,0 +1,399 @@
+#pragma once
+
+#include "Sphere.h"
+#include "SphereSoA.h"
+#include "Ray.h"
+#include "Vec3D.h"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace pr {
+
+// Bounding volume hierarchy over the spheres of a scene.
+//
+// Without it, every ray is tested against every sphere : O(pixels x spheres). The BVH is a
+// binary tree of axis aligned boxes ; a ray only visits the nodes whose box it crosses, and
+// closer than the best hit found so far, so a ray costs O(log spheres) in practice.
+//
+// Build : top down, each node split along the axis and position minimizing the surface area
+// heuristic (SAH : expected cost of a ray crossing the node ~ area(child) x spheres(child)),
+// evaluated on 16 bins of the sphere centres rather than on every possible split.
+// The tree is flattened in a single vector of nodes, depth first, the two children of a node
+// being adjacent : no pointers, good locality for the traversal.
+// The leaves keep their own copy of the sphere centres and radii (SphereSoA), in leaf order :
+// a leaf is a contiguous range, intersected with the SIMD kernels. Queries answer indices into
+// the vector of spheres the BVH was built from.
+class BVH {
+	struct Node {
+		double bmin[3];
+		double bmax[3];
+		uint32_t first; // leaf : first sphere in leaves_ ; inner node : index of the left child
+		uint32_t count; // leaf : number of spheres ; 0 for an inner node
+		bool isLeaf() const { return count != 0; }
+	};
+	struct Box {
+		double bmin[3] = { inf(), inf(), inf() };
+		double bmax[3] = { -inf(), -inf(), -inf() };
+		void grow(const Box & b) {
+			for (int a = 0; a < 3; a++) {
+				bmin[a] = std::min(bmin[a], b.bmin[a]);
+				bmax[a] = std::max(bmax[a], b.bmax[a]);
+			}
+		}
+		void grow(const double p[3]) {
+			for (int a = 0; a < 3; a++) {
+				bmin[a] = std::min(bmin[a], p[a]);
+				bmax[a] = std::max(bmax[a], p[a]);
+			}
+		}
+		double area() const {
+			double dx = bmax[0] - bmin[0], dy = bmax[1] - bmin[1], dz = bmax[2] - bmin[2];
+			if (dx < 0) {
+				return 0; // vide
+			}
+			return 2 * (dx * dy + dy * dz + dz * dx);
+		}
+	};
+	static constexpr double inf() { return std::numeric_limits<double>::infinity(); }
+	static constexpr int BINS = 16;
+	static constexpr uint32_t MAX_LEAF = 8;
+	static constexpr int STACK = 64;
+
+	std::vector<Node> nodes_;
+	SphereSoA leaves_;
+	// during build only : box and centre of each sphere, partitioned in place with the
+	// index, so that the build scans contiguous memory rather than the spheres themselves
+	struct Item {
+		Box box;
+		double centre[3];
+		uint32_t index;
+	};
+	std::vector<Item> items_;
+	int depth_ = 0;
+
+	static Box boxOf(const Sphere & s) {
+		Box b;
+		const Vec3D & c = s.getCentre();
+		double r = s.getRadius();
+		for (int a = 0; a < 3; a++) {
+			b.bmin[a] = c[a] - r;
+			b.bmax[a] = c[a] + r;
+		}
+		return b;
+	}
+
+public:
+	BVH() = default;
+
+	// builds the hierarchy over spheres ; an empty BVH answers -1 to every query
+	explicit BVH(const std::vector<Sphere> & spheres) {
+		nodes_.clear();
+		if (spheres.empty()) {
+			return;
+		}
+		items_.resize(spheres.size());
+		for (size_t i = 0; i < spheres.size(); i++) {
+			items_[i].box = boxOf(spheres[i]);
+			for (int a = 0; a < 3; a++) {
+				items_[i].centre[a] = spheres[i].getCentre()[a];
+			}
+			items_[i].index = uint32_t(i);
+		}
+		nodes_.reserve(2 * spheres.size());
+		nodes_.push_back(Node());
+		build(0, 0, uint32_t(spheres.size()), 1);
+		leaves_.reserve(items_.size());
+		for (const Item & item : items_) {
+			leaves_.push_back(spheres[item.index], item.index);
+		}
+		items_.clear();
+		items_.shrink_to_fit();
+	}
+
+	bool empty() const { return nodes_.empty(); }
+	size_t nodeCount() const { return nodes_.size(); }
+	int depth() const { return depth_; }
+
+	// index of the closest sphere hit by ray, -1 if none ; tbest gets its distance
+	// (along the normalized direction, as Sphere::intersects)
+	int closest(const RayQuery & ray, double & tbest, Isect kernel = Isect::Double) const {
+		tbest = std::numeric_limits<double>::max();
+		int best = -1;
+		if (!nodes_.empty()) {
+			closestFrom(ray, 0, tbest, best, kernel);
+		}
+		return best;
+	}
+
+#if PR_SIMD_AVX2
+	// closest for the 4 rays of a packet, traversed together : a node is visited if any active
+	// ray enters it before its own best hit, and the leaves test each sphere against all the
+	// rays at once. Same results as closest, ray by ray. When a single ray is left in a
+	// subtree, the packet diverges : that ray finishes alone with the single ray traversal.
+	// AVX2 only, the caller checks SphereSoA::hasAVX2().
+	PR_TARGET_AVX2 void closestPacket(const RayPacket & p, double * tbest, int * best) const {
+		for (int l = 0; l < RayPacket::N; l++) {
+			tbest[l] = std::numeric_limits<double>::max();
+			best[l] = -1;
+		}
+		if (nodes_.empty()) {
+			return;
+		}
+		const __m256d ori[3] = { _mm256_load_pd(p.o[0]), _mm256_load_pd(p.o[1]), _mm256_load_pd(p.o[2]) };
+		const __m256d one = _mm256_set1_pd(1.0);
+		const __m256d inv[3] = { _mm256_div_pd(one, _mm256_load_pd(p.d[0])), _mm256_div_pd(one, _mm256_load_pd(p.d[1])),
+		                         _mm256_div_pd(one, _mm256_load_pd(p.d[2])) };
+		const int full = p.full();
+
+		uint32_t stack[STACK];
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0) {
+			uint32_t index = stack[--top];
+			const Node & node = nodes_[index];
+			__m256d entry;
+			int active = slabPacket(node, ori, inv, _mm256_loadu_pd(tbest), entry) & full;
+			if (active == 0) {
+				continue;
+			}
+			if ((active & (active - 1)) == 0) {
+				// un seul rayon : le paquet n'apporte plus rien sur ce sous-arbre
+				int l = __builtin_ctz(unsigned(active));
+				closestFrom(p.lane(l), index, tbest[l], best[l], Isect::Double);
+				continue;
+			}
+			if (node.isLeaf()) {
+				leaves_.closestPacket(p, active, node.first, node.first + node.count, tbest, best);
+				continue;
+			}
+			// l'enfant ou les rayons actifs entrent le plus tot d'abord
+			uint32_t left = node.first, right = node.first + 1;
+			__m256d el, er;
+			int ml = slabPacket(nodes_[left], ori, inv, _mm256_loadu_pd(tbest), el) & active;
+			int mr = slabPacket(nodes_[right], ori, inv, _mm256_loadu_pd(tbest), er) & active;
+			double tl = minLane(el, ml), tr = minLane(er, mr);
+			if (tl > tr) {
+				std::swap(left, right);
+				std::swap(ml, mr);
+			}
+			if (mr != 0) {
+				stack[top++] = right;
+			}
+			if (ml != 0) {
+				stack[top++] = left;
+			}
+		}
+	}
+#endif
+
+
+	// true if some sphere other than ignore is hit at a distance below tmax (any hit : the
+	// traversal stops at the first one found), e.g. for shadow rays
+	bool occluded(const RayQuery & ray, double tmax, int ignore = -1, Isect kernel = Isect::Double) const {
+		if (nodes_.empty()) {
+			return false;
+		}
+		const double * ori = ray.o;
+		const double inv[3] = { 1.0 / ray.d[0], 1.0 / ray.d[1], 1.0 / ray.d[2] };
+		uint32_t stack[STACK];
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0) {
+			const Node & node = nodes_[stack[--top]];
+			if (slab(node, ori, inv, tmax) == inf()) {
+				continue;
+			}
+			if (node.isLeaf()) {
+				if (leaves_.any(ray, node.first, node.first + node.count, tmax, ignore, kernel)) {
+					return true;
+				}
+				continue;
+			}
+			stack[top++] = node.first;
+			stack[top++] = node.first + 1;
+		}
+		return false;
+	}
+
+private:
+	// closest from the given node, improving on tbest / best
+	void closestFrom(const RayQuery & ray, uint32_t root, double & tbest, int & best, Isect kernel) const {
+		const double * ori = ray.o;
+		const double inv[3] = { 1.0 / ray.d[0], 1.0 / ray.d[1], 1.0 / ray.d[2] };
+
+		uint32_t stack[STACK];
+		int top = 0;
+		stack[top++] = root;
+		while (top > 0) {
+			const Node & node = nodes_[stack[--top]];
+			if (slab(node, ori, inv, tbest) == inf()) {
+				continue; // plus loin que le meilleur, ou rate
+			}
+			if (node.isLeaf()) {
+				// a egalite on garde le plus petit indice, comme le parcours lineaire
+				leaves_.closest(ray, node.first, node.first + node.count, tbest, best, kernel);
+				continue;
+			}
+			// visiter d'abord l'enfant le plus proche : il reduit tbest, qui elague l'autre
+			uint32_t left = node.first, right = node.first + 1;
+			double tl = slab(nodes_[left], ori, inv, tbest);
+			double tr = slab(nodes_[right], ori, inv, tbest);
+			if (tl > tr) {
+				std::swap(tl, tr);
+				std::swap(left, right);
+			}
+			if (tr != inf()) {
+				stack[top++] = right;
+			}
+			if (tl != inf()) {
+				stack[top++] = left;
+			}
+		}
+	}
+
+	// entry distance of the ray in the box of node, inf if it misses it or enters beyond tmax
+	static double slab(const Node & node, const double ori[3], const double inv[3], double tmax) {
+		double tmin = 0;
+		for (int a = 0; a < 3; a++) {
+			double t0 = (node.bmin[a] - ori[a]) * inv[a];
+			double t1 = (node.bmax[a] - ori[a]) * inv[a];
+			if (t0 > t1) {
+				std::swap(t0, t1);
+			}
+			tmin = std::max(tmin, t0);
+			tmax = std::min(tmax, t1);
+		}
+		return tmin <= tmax ? tmin : inf();
+	}
+
+#if PR_SIMD_AVX2
+	// slab for the 4 rays of a packet, lane by lane the same operations as slab : the mask of
+	// the rays entering the box before their tmax, and their entry distances
+	PR_TARGET_AVX2 static int slabPacket(const Node & node, const __m256d ori[3], const __m256d inv[3], __m256d tmax, __m256d & entry) {
+		__m256d tmin = _mm256_setzero_pd();
+		for (int a = 0; a < 3; a++) {
+			__m256d t0 = _mm256_mul_pd(_mm256_sub_pd(_mm256_set1_pd(node.bmin[a]), ori[a]), inv[a]);
+			__m256d t1 = _mm256_mul_pd(_mm256_sub_pd(_mm256_set1_pd(node.bmax[a]), ori[a]), inv[a]);
+			__m256d swap = _mm256_cmp_pd(t0, t1, _CMP_GT_OQ);
+			__m256d lo = _mm256_blendv_pd(t0, t1, swap);
+			__m256d hi = _mm256_blendv_pd(t1, t0, swap);
+			tmin = _mm256_max_pd(lo, tmin); // std::max(tmin, lo), NaN compris
+			tmax = _mm256_min_pd(hi, tmax); // std::min(tmax, hi)
+		}
+		entry = tmin;
+		return _mm256_movemask_pd(_mm256_cmp_pd(tmin, tmax, _CMP_LE_OQ));
+	}
+
+	PR_TARGET_AVX2 static double minLane(__m256d v, int mask) {
+		alignas(32) double t[4];
+		_mm256_store_pd(t, v);
+		double m = inf();
+		for (int l = 0; l < 4; l++) {
+			if (mask & (1 << l)) {
+				m = std::min(m, t[l]);
+			}
+		}
+		return m;
+	}
+#endif
+
+	void makeLeaf(Node & node, uint32_t first, uint32_t count) {
+		node.first = first;
+		node.count = count;
+	}
+
+	void build(uint32_t nodeIndex, uint32_t first, uint32_t count, int depth) {
+		depth_ = std::max(depth_, depth);
+		Box bounds, centroids;
+		for (uint32_t i = first; i < first + count; i++) {
+			bounds.grow(items_[i].box);
+			centroids.grow(items_[i].centre);
+		}
+		{
+			Node & node = nodes_[nodeIndex];
+			for (int a = 0; a < 3; a++) {
+				node.bmin[a] = bounds.bmin[a];
+				node.bmax[a] = bounds.bmax[a];
+			}
+			if (count <= 2) {
+				makeLeaf(node, first, count);
+				return;
+			}
+		}
+
+		// SAH sur BINS intervalles des centres, pour chaque axe
+		int bestAxis = -1;
+		int bestSplit = 0;
+		double bestCost = inf();
+		for (int a = 0; a < 3; a++) {
+			double lo = centroids.bmin[a], hi = centroids.bmax[a];
+			if (hi <= lo) {
+				continue; // tous les centres alignes sur cet axe
+			}
+			Box binBox[BINS];
+			uint32_t binCount[BINS] = {};
+			double scale = BINS / (hi - lo);
+			for (uint32_t i = first; i < first + count; i++) {
+				int b = std::min(BINS - 1, int((items_[i].centre[a] - lo) * scale));
+				binCount[b]++;
+				binBox[b].grow(items_[i].box);
+			}
+			// balayage : aire et effectif a gauche de chaque coupe, puis a droite
+			double leftArea[BINS - 1];
+			uint32_t leftCount[BINS - 1];
+			Box acc;
+			uint32_t n = 0;
+			for (int b = 0; b < BINS - 1; b++) {
+				acc.grow(binBox[b]);
+				n += binCount[b];
+				leftArea[b] = acc.area();
+				leftCount[b] = n;
+			}
+			acc = Box();
+			n = 0;
+			for (int b = BINS - 1; b > 0; b--) {
+				acc.grow(binBox[b]);
+				n += binCount[b];
+				double cost = leftArea[b - 1] * leftCount[b - 1] + acc.area() * n;
+				if (leftCount[b - 1] > 0 && n > 0 && cost < bestCost) {
+					bestCost = cost;
+					bestAxis = a;
+					bestSplit = b;
+				}
+			}
+		}
+
+		Node & node = nodes_[nodeIndex];
+		// couts relatifs : traverser un noeud ~ tester une sphere, pondere par l'aire
+		double leafCost = bounds.area() * count;
+		bool small = count <= MAX_LEAF;
+		if ((bestAxis < 0 && small) || (bestAxis >= 0 && small && bestCost + bounds.area() >= leafCost) || depth >= STACK - 4) {
+			makeLeaf(node, first, count);
+			return;
+		}
+		uint32_t mid;
+		if (bestAxis < 0) {
+			mid = first + count / 2; // centres confondus : coupe arbitraire en deux
+		} else {
+			double lo = centroids.bmin[bestAxis];
+			double scale = BINS / (centroids.bmax[bestAxis] - lo);
+			auto it = std::partition(items_.begin() + first, items_.begin() + first + count, [&](const Item & item) {
+				int b = std::min(BINS - 1, int((item.centre[bestAxis] - lo) * scale));
+				return b < bestSplit;
+			});
+			mid = uint32_t(it - items_.begin());
+		}
+		uint32_t left = uint32_t(nodes_.size());
+		node.first = left;
+		node.count = 0;
+		// attention : push_back peut invalider la reference node
+		nodes_.push_back(Node());
+		nodes_.push_back(Node());
+		build(left, first, mid - first, depth + 1);
+		build(left + 1, mid, first + count - mid, depth + 1);
+	}
+};
+
+} /* namespace pr */
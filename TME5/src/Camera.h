@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Vec3D.h"
+#include "Ray.h"
+
+namespace pr {
+
+// Une camera a stenope : une position, une direction de vue, et un ecran plan de width x height
+// pixels a distance fixe devant elle.
+// Le point de l'ecran d'un pixel est calcule a la demande, a partir de l'origine de l'ecran et
+// de deux pas (un pixel vers la droite, un vers le haut) : aucune memoire par pixel, quelle que
+// soit la resolution.
+class Camera {
+	Vec3D position;
+	Vec3D viewDir;
+	// repere de l'ecran
+	Vec3D screenCenter;
+	Vec3D right;
+	Vec3D up;
+	int width;
+	int height;
+	double pixelSizeX;
+	double pixelSizeY;
+public:
+	// position, direction de la vue (normalisee ici), resolution ; screenWidth est la largeur de
+	// l'ecran dans la scene, distance son eloignement de la camera
+	Camera(int width = 800, int height = 600, const Vec3D & position = Vec3D(0, 0, -1000), const Vec3D & viewDir = Vec3D(0, 0, 1),
+	       double distance = 1000.0, double screenWidth = 400)
+		: position(position), viewDir(viewDir.normalize()), width(width), height(height) {
+		screenCenter = position + distance * this->viewDir;
+		// up vector
+		Vec3D up0(0, 1, 0);
+		// right vector
+		right = (this->viewDir * up0).normalize();
+		// re-orthogonalize up
+		up = (right * this->viewDir).normalize();
+
+		double H = (screenWidth * height) / width;
+		pixelSizeX = screenWidth / width;
+		pixelSizeY = H / height;
+	}
+
+	// le point de l'ecran du pixel (x, y) : memes operations que l'ancien ecran precalcule,
+	// donc exactement les memes points. Coordonnees non entieres : un point entre les pixels,
+	// pour le sur-echantillonnage.
+	Vec3D screenPoint(double x, double y) const {
+		Vec3D offset = (x - width / 2.0) * pixelSizeX * right + (y - height / 2.0) * pixelSizeY * up;
+		return screenCenter + offset;
+	}
+
+	// le rayon de la camera passant par le pixel (x, y)
+	Ray ray(double x, double y) const { return Ray(position, screenPoint(x, y)); }
+
+	const Vec3D & getPosition() const { return position; }
+	const Vec3D & getViewDir() const { return viewDir; }
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+};
+
+} /* namespace pr */
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "Camera.h"
+#include "Vec3D.h"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+namespace pr {
+
+// une position cle de la camera : ou elle est, et le point qu'elle vise
+struct CameraKey {
+	Vec3D position;
+	Vec3D target;
+};
+
+// Une trajectoire de camera : des positions cles, reliees par des segments parcourus chacun
+// dans le meme temps. at(u) interpole position et point vise, pour u de 0 (premiere cle) a 1
+// (derniere).
+class CameraPath {
+	std::vector<CameraKey> keys;
+	// la derniere cle est la premiere (un tour complet) : une animation qui boucle
+	bool closed;
+public:
+	// au moins une cle
+	explicit CameraPath(std::vector<CameraKey> keys, bool closed = false) : keys(std::move(keys)), closed(closed) {}
+
+	CameraKey at(double u) const {
+		if (keys.size() == 1) {
+			return keys.front();
+		}
+		double s = std::clamp(u, 0.0, 1.0) * double(keys.size() - 1);
+		size_t i = std::min(size_t(s), keys.size() - 2);
+		double f = s - double(i);
+		const CameraKey & a = keys[i];
+		const CameraKey & b = keys[i + 1];
+		return CameraKey{a.position * (1 - f) + b.position * f, a.target * (1 - f) + b.target * f};
+	}
+
+	// la camera de l'image frame sur frames, les autres parametres comme la camera par defaut.
+	// Chemin ouvert : la premiere image sur la premiere cle, la derniere sur la derniere.
+	// Chemin ferme : la derniere cle n'est pas rendue, elle repeterait la premiere image quand
+	// l'animation boucle ; les images sont reparties sur [0, 1).
+	Camera camera(int frame, int frames, int width, int height) const {
+		double u = closed ? double(frame) / frames : frames > 1 ? double(frame) / (frames - 1) : 0.0;
+		CameraKey k = at(u);
+		return Camera(width, height, k.position, k.target - k.position);
+	}
+
+	// un tour de degrees degres autour de l'axe vertical passant par target, en partant de
+	// start, la camera visant toujours target. Une cle par degre : les cordes s'ecartent du
+	// cercle de moins de 4e-5 fois le rayon. Ferme si degrees est un multiple de 360.
+	static CameraPath orbit(const Vec3D & target, const Vec3D & start, double degrees) {
+		const int steps = std::max(1, int(std::ceil(std::abs(degrees))));
+		const Vec3D r = start - target;
+		std::vector<CameraKey> keys;
+		keys.reserve(steps + 1);
+		for (int i = 0; i <= steps; i++) {
+			double a = degrees * M_PI / 180.0 * i / steps;
+			double c = std::cos(a), s = std::sin(a);
+			Vec3D p(r.getX() * c - r.getZ() * s, r.getY(), r.getX() * s + r.getZ() * c);
+			keys.push_back(CameraKey{target + p, target});
+		}
+		const bool closed = degrees != 0 && std::fmod(std::abs(degrees), 360.0) == 0;
+		return CameraPath(std::move(keys), closed);
+	}
+};
+
+} /* namespace pr */
@@ -14,6 +14,10 @@ class Color {
 	unsigned char r;
 public:
 	constexpr Color(unsigned char red = 255, unsigned char green = 255, unsigned char blue = 255) : b(blue), g(green), r(red) {}
+	// composantes
+	unsigned char getR() const { return r; }
+	unsigned char getG() const { return g; }
+	unsigned char getB() const { return b; }
 	// shade by ratio / assombrir
 	Color operator *(double ratio) {
 		if (ratio > 1) {
@@ -36,9 +40,15 @@ namespace Colors {
 	constexpr Color blue (0, 0, 255);
 	constexpr Color black (0, 0, 0);
 
+	inline Color random(Xoshiro256 & rng) {
+		// 30 minimum to avoid too dark colors ; one draw per statement, in a fixed order
+		unsigned char r = rng.range(30, 256);
+		unsigned char g = rng.range(30, 256);
+		unsigned char b = rng.range(30, 256);
+		return Color(r, g, b);
+	}
 	inline Color random() {
-		// 30 minimum to avoid too dark colors
-		return Color(mtrand(30, 256), mtrand(30, 256), mtrand(30, 256));
+		return random(threadRng());
 	}
 }
 
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+namespace pr {
+
+class Pool;
+
+namespace detail {
+
+// Per thread cache of small fixed size blocks, for the nodes of Pool::async.
+// A node is allocated by the submitting thread and freed by whichever thread releases it
+// last ; the block then goes to the cache of that thread. In steady state (submit, get,
+// submit...) no call to operator new is made at all.
+class BlockCache {
+	static constexpr size_t CLASSES = 3; // 64, 128, 256 bytes
+	static constexpr size_t MAX_CACHED = 256; // per class and per thread
+	struct FreeBlock {
+		FreeBlock * next;
+	};
+	FreeBlock * heads_[CLASSES] = {};
+	size_t counts_[CLASSES] = {};
+
+	static int classOf(size_t size, size_t align) {
+		if (align > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+			return -1;
+		}
+		return size <= 64 ? 0 : size <= 128 ? 1 : size <= 256 ? 2 : -1;
+	}
+	static BlockCache & local() {
+		thread_local BlockCache cache;
+		return cache;
+	}
+public:
+	static void * allocate(size_t size, size_t align) {
+		int c = classOf(size, align);
+		if (c < 0) {
+			return ::operator new(size, std::align_val_t(align));
+		}
+		BlockCache & cache = local();
+		if (FreeBlock * b = cache.heads_[c]) {
+			cache.heads_[c] = b->next;
+			cache.counts_[c]--;
+			return b;
+		}
+		return ::operator new(size_t(64) << c);
+	}
+	static void deallocate(void * p, size_t size, size_t align) {
+		int c = classOf(size, align);
+		if (c < 0) {
+			::operator delete(p, std::align_val_t(align));
+			return;
+		}
+		BlockCache & cache = local();
+		if (cache.counts_[c] >= MAX_CACHED) {
+			::operator delete(p);
+			return;
+		}
+		FreeBlock * b = static_cast<FreeBlock*>(p);
+		b->next = cache.heads_[c];
+		cache.heads_[c] = b;
+		cache.counts_[c]++;
+	}
+	~BlockCache() {
+		for (size_t c = 0; c < CLASSES; c++) {
+			while (FreeBlock * b = heads_[c]) {
+				heads_[c] = b->next;
+				::operator delete(b);
+			}
+		}
+	}
+};
+
+// storage for the result, none for void
+template <typename R>
+class Result {
+	alignas(R) unsigned char buf_[sizeof(R)];
+	bool has_ = false;
+public:
+	template <typename F>
+	void emplace(F & f) {
+		new (buf_) R(f());
+		has_ = true;
+	}
+	R take() {
+		return std::move(*std::launder(reinterpret_cast<R*>(buf_)));
+	}
+	~Result() {
+		if (has_) {
+			std::launder(reinterpret_cast<R*>(buf_))->~R();
+		}
+	}
+};
+template <>
+class Result<void> {
+public:
+	template <typename F>
+	void emplace(F & f) {
+		f();
+	}
+	void take() {}
+};
+
+// Shared between a Future and the task that computes its value, which live in one node.
+// Two references : the task drops its own once the value is set, the future once it has
+// been read (or the future is dropped) ; the last one frees the node.
+template <typename R>
+struct FutureState {
+	std::atomic<uint32_t> ready{0};
+	std::atomic<uint32_t> refs{2};
+	std::exception_ptr error;
+	Result<R> result;
+	void * owner = nullptr;        // the node
+	void (*destroy)(void*) = nullptr;
+
+	template <typename F>
+	void run(F & f) {
+		try {
+			result.emplace(f);
+		} catch (...) {
+			error = std::current_exception();
+		}
+		ready.store(1, std::memory_order_release);
+		ready.notify_all();
+	}
+	void release() {
+		if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			destroy(owner);
+		}
+	}
+};
+
+} // namespace detail
+
+// The result of Pool::async : a move only handle, get() once to obtain the value or the
+// exception thrown by the task.
+// Waiting does not just block : while the value is not ready, the waiting thread runs other
+// tasks of the pool. This keeps the cores busy, and above all makes nested parallelism safe :
+// a task waiting for subtasks may end up running them itself instead of deadlocking the pool.
+template <typename R>
+class Future {
+	friend class Pool;
+	detail::FutureState<R> * state_ = nullptr;
+	bool (*help_)(void*) = nullptr; // runs one pending task of the pool, false if none
+	void * pool_ = nullptr;
+
+	Future(detail::FutureState<R> * state, bool (*help)(void*), void * pool) : state_(state), help_(help), pool_(pool) {}
+
+	static constexpr int HELP_ROUNDS = 64; // before blocking when there is nothing to help with
+public:
+	Future() = default;
+	Future(Future && other) noexcept : state_(std::exchange(other.state_, nullptr)), help_(other.help_), pool_(other.pool_) {}
+	Future & operator=(Future && other) noexcept {
+		if (this != &other) {
+			if (state_) {
+				state_->release();
+			}
+			state_ = std::exchange(other.state_, nullptr);
+			help_ = other.help_;
+			pool_ = other.pool_;
+		}
+		return *this;
+	}
+	Future(const Future &) = delete;
+	Future & operator=(const Future &) = delete;
+
+	// dropping a future does not wait for the task, its result is then discarded
+	~Future() {
+		if (state_) {
+			state_->release();
+		}
+	}
+
+	bool valid() const {
+		return state_ != nullptr;
+	}
+	bool ready() const {
+		return state_->ready.load(std::memory_order_acquire) != 0;
+	}
+
+	void wait() const {
+		int idle = 0;
+		while (!ready()) {
+			if (help_ && help_(pool_)) {
+				idle = 0;
+			} else if (++idle < HELP_ROUNDS) {
+				std::this_thread::yield();
+			} else {
+				state_->ready.wait(0, std::memory_order_acquire);
+			}
+		}
+	}
+
+	// waits, then returns the value or rethrows the exception of the task ; only once
+	R get() {
+		wait();
+		detail::FutureState<R> * s = std::exchange(state_, nullptr);
+		struct Release {
+			detail::FutureState<R> * s;
+			~Release() { s->release(); }
+		} guard{s};
+		if (s->error) {
+			std::rethrow_exception(s->error);
+		}
+		return s->result.take();
+	}
+};
+
+} /* namespace pr */
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "Vec3D.h"
+#include <limits>
+
+namespace pr {
+
+// Le resultat d'une intersection rayon/scene : calcule une fois par Scene::intersect, puis
+// utilise tel quel par l'eclairage (Scene::computeColor) sans refaire d'intersection.
+struct Hit {
+	// distance le long de la direction normalisee du rayon
+	double t = std::numeric_limits<double>::max();
+	// indice de la sphere touchee, -1 si aucune
+	int index = -1;
+	// le point d'intersection, et la normale a la sphere en ce point
+	Vec3D point;
+	Vec3D normal;
+
+	bool found() const { return index >= 0; }
+};
+
+} /* namespace pr */
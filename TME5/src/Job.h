@@ -9,6 +9,7 @@ public:
 };
 
 // Job concret : exemple
+// (pour recuperer un resultat sans out-parameter, voir plutot Pool::async, qui rend un Future)
 
 /**
 class SleepJob : public Job {
@@ -1,38 +1,330 @@
 #pragma once
 
-#include "Queue.h"
+#include "QueueLF.h"
+#include "WSDeque.h"
 #include "Job.h"
-#include <vector>
+#include "Future.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <memory>
 #include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace pr {
 
+// Work-stealing thread pool.
+//
+// Each worker owns a deque (WSDeque) : the tasks it submits itself (e.g. a job that splits
+// its work) go to its own deque, with no synchronization in the common case. A worker with
+// nothing to do takes from the shared injection queue, which receives the submissions from
+// outside the pool, then tries to steal from the other workers, starting from a random
+// victim so that thieves spread out. When all of that fails, it parks on an atomic wait
+// until some work is submitted.
+//
+// Three ways to submit :
+//  - submit(Job*) : the classic virtual Job, deleted by the pool once run ;
+//  - submit(f) : any callable, stored in a task that carries a plain function pointer,
+//    no virtual call nor Job subclass needed : pool.submit([&, y] { renderRow(y); });
+//  - async(f) : same, and returns a Future for the result of f (or its exception) :
+//    auto fut = pool.async([] { return 42; }); int v = fut.get();
+// and on top of async, parallel_for(begin, end, grain, f) calls f(i) on the whole range.
 class Pool {
-	Queue<Job> queue;
+	// a task : a function pointer that runs, then deletes, its own task
+	struct Task {
+		void (*exec)(Task*);
+	};
+	template <typename F>
+	struct FnTask : Task {
+		F f;
+		explicit FnTask(F && fn) : Task{&FnTask::run}, f(std::move(fn)) {}
+		explicit FnTask(const F & fn) : Task{&FnTask::run}, f(fn) {}
+		static void run(Task* t) {
+			FnTask* self = static_cast<FnTask*>(t);
+			self->f();
+			delete self;
+		}
+	};
+	struct JobTask : Task {
+		Job* job;
+		explicit JobTask(Job* j) : Task{&JobTask::run}, job(j) {}
+		static void run(Task* t) {
+			JobTask* self = static_cast<JobTask*>(t);
+			self->job->run();
+			delete self->job;
+			delete self;
+		}
+	};
+
+	// task and future state in a single node, taken from the per thread block cache : the
+	// callable is stored inline, with no further allocation
+	template <typename F, typename R>
+	struct AsyncTask : Task {
+		detail::FutureState<R> state;
+		F f;
+		template <typename G>
+		explicit AsyncTask(G && fn) : Task{&AsyncTask::run}, f(std::forward<G>(fn)) {
+			state.owner = this;
+			state.destroy = &AsyncTask::destroy;
+		}
+		static void run(Task* t) {
+			AsyncTask* self = static_cast<AsyncTask*>(t);
+			self->state.run(self->f);
+			self->state.release();
+		}
+		static void destroy(void* p) {
+			AsyncTask* self = static_cast<AsyncTask*>(p);
+			self->~AsyncTask();
+			detail::BlockCache::deallocate(self, sizeof(AsyncTask), alignof(AsyncTask));
+		}
+	};
+
+	struct Worker {
+		WSDeque<Task> deque;
+		uint64_t rng; // xorshift state, for victim selection
+	};
+
+	QueueLF<Task> inject_; // submissions from outside the pool
+	std::vector<std::unique_ptr<Worker>> workers_;
 	std::vector<std::thread> threads;
+	std::atomic<bool> stopping_{false};
+	// parking : idle workers wait on signal_, submitters bump it if anyone sleeps
+	std::atomic<uint32_t> signal_{0};
+	std::atomic<int> sleepers_{0};
+
+	// the pool and worker index of the current thread, if it is a worker
+	static inline thread_local Pool* tl_pool = nullptr;
+	static inline thread_local size_t tl_index = 0;
+
+	static constexpr int SPIN_ROUNDS = 32;
+
 public:
-	// create a pool with a queue of given size
-	Pool(int qsize) {/*TODO*/
-	}
+	// create a pool, external submissions go through a queue of given size
+	Pool(int qsize) : inject_(qsize > 0 ? size_t(qsize) : 1) {}
+	Pool(const Pool &) = delete;
+	Pool & operator=(const Pool &) = delete;
+
 	// start the pool with nbthread workers
 	void start (int nbthread) {
-		/*TODO*/
+		stopping_.store(false);
+		workers_.clear();
+		for (int i = 0; i < nbthread; i++) {
+			workers_.push_back(std::make_unique<Worker>());
+			workers_.back()->rng = 0x9E3779B97F4A7C15ull * uint64_t(i + 1);
+		}
 		for (int i = 0; i < nbthread; i++) {
 			// syntaxe pour passer une methode membre au thread
-			threads.emplace_back(&Pool::worker, this);
+			threads.emplace_back(&Pool::worker, this, size_t(i));
 		}
 	}
 
-	// submit a job to be executed by the pool
-	void submit (Job * job) { /*TODO*/}
-	
-	// initiate shutdown, wait for threads to finish
-	void stop() { }
-	
+	// submit a job to be executed by the pool ; the pool deletes it once run
+	void submit (Job * job) {
+		submitTask(new JobTask(job));
+	}
+
+	// submit any callable, e.g. a lambda ; no virtual dispatch
+	template <typename F, typename = std::enable_if_t<!std::is_convertible_v<F, Job*>>>
+	void submit (F && f) {
+		submitTask(new FnTask<std::decay_t<F>>(std::forward<F>(f)));
+	}
+
+	// submit f, get a Future for its result ; exceptions thrown by f are rethrown by get()
+	template <typename F>
+	auto async (F && f) -> Future<std::invoke_result_t<std::decay_t<F>&>> {
+		using R = std::invoke_result_t<std::decay_t<F>&>;
+		using Node = AsyncTask<std::decay_t<F>, R>;
+		void* mem = detail::BlockCache::allocate(sizeof(Node), alignof(Node));
+		Node* node = new (mem) Node(std::forward<F>(f));
+		Future<R> future(&node->state, &Pool::helpOne, this);
+		submitTask(node);
+		return future;
+	}
+
+	// f(i) for all i in [begin, end), in chunks of grain consecutive indices handed out
+	// dynamically to the workers and to the calling thread, which takes part.
+	// Returns once the whole range is done ; the first exception thrown by f is rethrown,
+	// the chunks not yet started are then skipped.
+	template <typename F>
+	void parallel_for (size_t begin, size_t end, size_t grain, F && f) {
+		if (begin >= end) {
+			return;
+		}
+		grain = std::max<size_t>(grain, 1);
+		const size_t nchunks = (end - begin + grain - 1) / grain;
+		std::atomic<size_t> next{0};
+		auto body = [&] {
+			for (size_t c; (c = next.fetch_add(1, std::memory_order_relaxed)) < nchunks;) {
+				size_t lo = begin + c * grain;
+				size_t hi = std::min(end, lo + grain);
+				for (size_t i = lo; i < hi; i++) {
+					f(i);
+				}
+			}
+		};
+		// one helper task per worker at most, the caller runs the body too
+		size_t helpers = std::min(nchunks - 1, workers_.size());
+		std::vector<Future<void>> futures;
+		futures.reserve(helpers);
+		for (size_t h = 0; h < helpers; h++) {
+			futures.push_back(async(body));
+		}
+		std::exception_ptr error;
+		try {
+			body();
+		} catch (...) {
+			error = std::current_exception();
+			next.store(nchunks, std::memory_order_relaxed);
+		}
+		// body refers to our locals : wait for every helper, even on error
+		for (auto & fut : futures) {
+			try {
+				fut.get();
+			} catch (...) {
+				if (!error) {
+					error = std::current_exception();
+				}
+				next.store(nchunks, std::memory_order_relaxed);
+			}
+		}
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	}
+
+	// initiate shutdown : all the submitted jobs are run, then wait for threads to finish
+	void stop() {
+		stopping_.store(true);
+		signal_.fetch_add(1);
+		signal_.notify_all();
+		for (auto & t : threads) {
+			t.join();
+		}
+		threads.clear();
+		// never started : run what was submitted here
+		while (Task* t = inject_.pop()) {
+			t->exec(t);
+		}
+	}
+
+	~Pool() {
+		stop();
+	}
+
+	// true if the calling thread is one of our workers
+	bool isWorker() const {
+		return tl_pool == this;
+	}
 
 private:
+	void submitTask(Task* t) {
+		if (tl_pool == this) {
+			workers_[tl_index]->deque.push(t);
+		} else {
+			while (!inject_.push(t)) {
+				// queue pleine : le soumetteur aide plutot que d'attendre
+				if (Task* other = inject_.pop()) {
+					other->exec(other);
+				}
+			}
+		}
+		wake();
+	}
+
+	void wake() {
+		// pairs with the fetch_add on sleepers_ in worker : either we see the sleeper,
+		// or it sees our task when it checks again before waiting
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (sleepers_.load(std::memory_order_relaxed) > 0) {
+			signal_.fetch_add(1, std::memory_order_release);
+			signal_.notify_one();
+		}
+	}
+
+	// for Future::wait : run one task, from our deque (and steals) if we are a worker of
+	// this pool, else from the injection queue
+	static bool helpOne(void* p) {
+		Pool* pool = static_cast<Pool*>(p);
+		Task* t = nullptr;
+		if (tl_pool == pool) {
+			t = pool->findTask(*pool->workers_[tl_index], tl_index);
+		} else {
+			t = pool->inject_.pop();
+		}
+		if (!t) {
+			return false;
+		}
+		t->exec(t);
+		return true;
+	}
+
+	static uint64_t nextRandom(uint64_t & s) {
+		s ^= s << 13;
+		s ^= s >> 7;
+		s ^= s << 17;
+		return s;
+	}
+
+	Task* findTask(Worker & self, size_t index) {
+		if (Task* t = self.deque.pop()) {
+			return t;
+		}
+		if (Task* t = inject_.pop()) {
+			return t;
+		}
+		size_t n = workers_.size();
+		if (n > 1) {
+			size_t start = size_t(nextRandom(self.rng) % n);
+			for (size_t k = 0; k < n; k++) {
+				size_t victim = (start + k) % n;
+				if (victim == index) {
+					continue;
+				}
+				if (Task* t = workers_[victim]->deque.steal()) {
+					return t;
+				}
+			}
+		}
+		return nullptr;
+	}
+
 	// worker thread function
-	void worker() { //todo
+	void worker(size_t index) {
+		tl_pool = this;
+		tl_index = index;
+		Worker & self = *workers_[index];
+		while (true) {
+			Task* t = nullptr;
+			for (int spin = 0; spin < SPIN_ROUNDS && !t; spin++) {
+				t = findTask(self, index);
+				if (!t) {
+					std::this_thread::yield();
+				}
+			}
+			if (t) {
+				t->exec(t);
+				continue;
+			}
+			// se garer : annoncer qu'on dort, puis verifier une derniere fois
+			uint32_t s = signal_.load(std::memory_order_acquire);
+			sleepers_.fetch_add(1, std::memory_order_seq_cst);
+			t = findTask(self, index);
+			if (t) {
+				sleepers_.fetch_sub(1);
+				t->exec(t);
+				continue;
+			}
+			if (stopping_.load()) {
+				sleepers_.fetch_sub(1);
+				break; // nothing left anywhere we can see
+			}
+			signal_.wait(s, std::memory_order_acquire);
+			sleepers_.fetch_sub(1);
+		}
+		tl_pool = nullptr;
 	}
 };
 
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+namespace pr {
+
+// Lock-free version of Queue, same interface : drop-in replacement in Pool.
+// Bounded multi-producer multi-consumer ring buffer, after Dmitry Vyukov's design.
+// Store pointers to T, not T itself ; consumer is responsible for deleting them.
+// nullptr is returned by pop if the queue is empty.
+// push returns false if the queue is full.
+//
+// Each cell carries a sequence number telling whose turn it is :
+//  seq == pos   : free, for the producer that reserved position pos
+//  seq == pos+1 : full, for the consumer that reserved position pos
+// Producers reserve positions by CAS on tail_, consumers on head_, each on its own
+// cache line, so producers and consumers do not contend unless the queue is full/empty.
+// The capacity is rounded up to a power of two (modulo becomes a mask).
+template <typename T>
+class QueueLF {
+	struct Cell {
+		std::atomic<size_t> seq;
+		T * data;
+	};
+	static constexpr size_t CACHE_LINE = 64;
+
+	const size_t mask_;
+	std::unique_ptr<Cell[]> tab_;
+	alignas(CACHE_LINE) std::atomic<size_t> tail_; // prochaine position d'ecriture
+	alignas(CACHE_LINE) std::atomic<size_t> head_; // prochaine position de lecture
+
+	static size_t roundUp(size_t n) {
+		size_t p = 2;
+		while (p < n) {
+			p <<= 1;
+		}
+		return p;
+	}
+public:
+	QueueLF(size_t size=10) : mask_(roundUp(size) - 1), tab_(new Cell[mask_ + 1]), tail_(0), head_(0) {
+		for (size_t i = 0; i <= mask_; i++) {
+			tab_[i].seq.store(i, std::memory_order_relaxed);
+			tab_[i].data = nullptr;
+		}
+	}
+	QueueLF(const QueueLF &) = delete;
+	QueueLF & operator=(const QueueLF &) = delete;
+
+	// approximate when used concurrently
+	size_t size() const {
+		size_t t = tail_.load(std::memory_order_acquire);
+		size_t h = head_.load(std::memory_order_acquire);
+		return t >= h ? t - h : 0;
+	}
+	T* pop() {
+		size_t pos = head_.load(std::memory_order_relaxed);
+		while (true) {
+			Cell & cell = tab_[pos & mask_];
+			size_t seq = cell.seq.load(std::memory_order_acquire);
+			auto diff = (std::ptrdiff_t) seq - (std::ptrdiff_t) (pos + 1);
+			if (diff == 0) {
+				if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					T * ret = cell.data;
+					// rend la case au producteur du tour suivant
+					cell.seq.store(pos + mask_ + 1, std::memory_order_release);
+					return ret;
+				}
+			} else if (diff < 0) {
+				return nullptr; // vide
+			} else {
+				pos = head_.load(std::memory_order_relaxed);
+			}
+		}
+	}
+	bool push(T* elt) {
+		size_t pos = tail_.load(std::memory_order_relaxed);
+		while (true) {
+			Cell & cell = tab_[pos & mask_];
+			size_t seq = cell.seq.load(std::memory_order_acquire);
+			auto diff = (std::ptrdiff_t) seq - (std::ptrdiff_t) pos;
+			if (diff == 0) {
+				if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					cell.data = elt;
+					cell.seq.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			} else if (diff < 0) {
+				return false; // plein
+			} else {
+				pos = tail_.load(std::memory_order_relaxed);
+			}
+		}
+	}
+	~QueueLF() {
+		// producer allocated, consumer should delete
+		// but we are destroyed with some elements still in the queue
+		while (T * elt = pop()) {
+			delete elt;
+		}
+	}
+};
+
+} /* namespace pr */
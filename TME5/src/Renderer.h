@@ -2,42 +2,470 @@
 
 #include "Scene.h"
 #include "Image.h"
+#include "BMPWriter.h"
+#include "AccumBuffer.h"
 #include "Ray.h"
+#include "Job.h"
+#include "Pool.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace pr {
 
 // Classe pour rendre une scène dans une image
+// Tous les modes calculent exactement la meme image, seule la repartition du travail change.
 class Renderer {
+    // tracer les rayons primaires par paquets de 4 (cf. renderBlock)
+    bool packets = false;
+    // la camera des rayons primaires, celle de la scene si nullptr (cf. setCamera)
+    const Camera* camera = nullptr;
 public:
+    Renderer() = default;
+    explicit Renderer(bool packets) : packets(packets) {}
+
+    void setPackets(bool p) { packets = p; }
+    bool getPackets() const { return packets; }
+
+    // rendre la scene vue d'une autre camera, de meme resolution : pour les images d'une
+    // animation, qui partagent les spheres et la BVH de la scene. nullptr : la camera de la scene.
+    // La camera doit vivre jusqu'a la fin du rendu.
+    void setCamera(const Camera* c) { camera = c; }
+
+    // les modes de rendu, dans l'ordre de presentation (cf. render(mode, ...))
+    static const std::vector<std::string>& modes() {
+        static const std::vector<std::string> all = {"sequential", "ThreadPerPixel", "ThreadPerRow", "ThreadManual",
+                                                     "PoolPixel", "PoolRow", "PoolFunctionalRow", "PoolTile"};
+        return all;
+    }
+
+    // Rend la scène dans l'image selon le mode ; nbthread et tile ne servent qu'aux modes
+    // qui en ont besoin. Rend false si le mode est inconnu.
+    bool render(const std::string& mode, const Scene& scene, Image& img, int nbthread, int tile = 32) {
+        if (mode == "sequential") {
+            render(scene, img);
+        } else if (mode == "ThreadPerPixel") {
+            renderThreadPerPixel(scene, img);
+        } else if (mode == "ThreadPerRow") {
+            renderThreadPerRow(scene, img);
+        } else if (mode == "ThreadManual") {
+            renderThreadManual(scene, img, nbthread);
+        } else if (mode == "PoolPixel") {
+            renderPoolPixel(scene, img, nbthread);
+        } else if (mode == "PoolRow") {
+            renderPoolRow(scene, img, nbthread);
+        } else if (mode == "PoolFunctionalRow") {
+            renderPoolFunctionalRow(scene, img, nbthread);
+        } else if (mode == "PoolTile") {
+            renderPoolTile(scene, img, nbthread, tile);
+        } else {
+            return false;
+        }
+        return true;
+    }
+
     // Rend la scène dans l'image
     void render(const Scene& scene, Image& img) {
-        // les points de l'ecran, en coordonnées 3D, au sein de la Scene.
-        // on tire un rayon de l'observateur vers chacun de ces points
-        const Scene::screen_t& screen = scene.getScreenPoints();
-
-        // pour chaque pixel, calculer sa couleur
-        for (int x = 0; x < scene.getWidth(); x++) {
-            for (int y = 0; y < scene.getHeight(); y++) {
-                // le point de l'ecran par lequel passe ce rayon
-                auto& screenPoint = screen[y][x];
-                // le rayon a inspecter
-                Ray ray(scene.getCameraPos(), screenPoint);
-
-                int targetSphere = scene.findClosestInter(ray);
-
-                if (targetSphere == -1) {
-                    // keep background color
+        renderRows(scene, img, 0, scene.getHeight());
+    }
+
+    // un thread par pixel : pour voir le cout de creation des threads.
+    // On joint a chaque ligne, sinon on aurait width*height threads vivants a la fois.
+    void renderThreadPerPixel(const Scene& scene, Image& img) {
+        for (int y = 0; y < scene.getHeight(); y++) {
+            std::vector<std::thread> threads;
+            threads.reserve(scene.getWidth());
+            for (int x = 0; x < scene.getWidth(); x++) {
+                threads.emplace_back([this, &scene, &img, x, y] { renderPixel(scene, img, x, y); });
+            }
+            for (auto& t : threads) {
+                t.join();
+            }
+        }
+    }
+
+    // un thread par ligne
+    void renderThreadPerRow(const Scene& scene, Image& img) {
+        std::vector<std::thread> threads;
+        threads.reserve(scene.getHeight());
+        for (int y = 0; y < scene.getHeight(); y++) {
+            threads.emplace_back([this, &scene, &img, y] { renderRows(scene, img, y, y + 1); });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+    }
+
+    // nbthread threads, chacun une bande contigue de lignes (decoupage statique)
+    void renderThreadManual(const Scene& scene, Image& img, int nbthread) {
+        int h = scene.getHeight();
+        std::vector<std::thread> threads;
+        for (int t = 0; t < nbthread; t++) {
+            int y0 = h * t / nbthread;
+            int y1 = h * (t + 1) / nbthread;
+            threads.emplace_back([this, &scene, &img, y0, y1] { renderRows(scene, img, y0, y1); });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+    }
+
+    // un Job par pixel, soumis a un Pool
+    void renderPoolPixel(const Scene& scene, Image& img, int nbthread) {
+        Pool pool(2 * nbthread + 16);
+        pool.start(nbthread);
+        for (int y = 0; y < scene.getHeight(); y++) {
+            for (int x = 0; x < scene.getWidth(); x++) {
+                pool.submit(new PixelJob(*this, scene, img, x, y));
+            }
+        }
+        pool.stop(); // attend la fin de tous les jobs
+    }
+
+    // un Job par ligne, soumis a un Pool
+    void renderPoolRow(const Scene& scene, Image& img, int nbthread) {
+        Pool pool(2 * nbthread + 16);
+        pool.start(nbthread);
+        for (int y = 0; y < scene.getHeight(); y++) {
+            pool.submit(new LineJob(*this, scene, img, y));
+        }
+        pool.stop();
+    }
+
+    // une lambda par ligne : pas de classe Job a ecrire
+    void renderPoolFunctionalRow(const Scene& scene, Image& img, int nbthread) {
+        Pool pool(2 * nbthread + 16);
+        pool.start(nbthread);
+        for (int y = 0; y < scene.getHeight(); y++) {
+            pool.submit([this, &scene, &img, y] { renderRows(scene, img, y, y + 1); });
+        }
+        pool.stop();
+    }
+
+    // Tuiles tile x tile, parcourues ligne par ligne : une tuile tient en cache, et deux threads
+    // n'ecrivent pas dans les memes lignes de cache de l'image (sauf aux bords des tuiles).
+    // Ordonnancement dynamique : chaque participant prend la tuile suivante sur un compteur
+    // atomique (Pool::parallel_for, grain 1), donc une region dense en spheres, plus lente,
+    // est absorbee par les autres threads au lieu d'en retarder un seul.
+    void renderPoolTile(const Scene& scene, Image& img, int nbthread, int tile = 32) {
+        tile = std::max(tile, 1);
+        const int w = scene.getWidth();
+        const int h = scene.getHeight();
+        const int tilesX = (w + tile - 1) / tile;
+        const int tilesY = (h + tile - 1) / tile;
+        Pool pool(2 * nbthread + 16);
+        // le thread appelant participe aussi
+        pool.start(std::max(nbthread - 1, 0));
+        pool.parallel_for(0, size_t(tilesX) * tilesY, 1, [&](size_t t) {
+            int x0 = int(t % tilesX) * tile;
+            int y0 = int(t / tilesX) * tile;
+            renderBlock(scene, img, x0, y0, std::min(x0 + tile, w), std::min(y0 + tile, h));
+        });
+        pool.stop();
+    }
+
+    // Anticrenelage adaptatif : un rayon par pixel d'abord, puis seulement les pixels de bord
+    // sont sur-echantillonnes. Un pixel est un bord si un de ses 8 voisins montre une autre
+    // sphere (ou le fond), ou une couleur qui differe de plus de threshold sur une composante.
+    // Les bords recoivent ensuite maxGrid x maxGrid rayons, aux centres des sous-pixels.
+    // Avec progress, ces rayons arrivent par niveaux de grilles emboitees (2x2, 4x4... maxGrid,
+    // cf. refinementGrids) : chaque niveau ne trace que ses nouveaux echantillons et les ajoute
+    // a la somme du pixel, sans refaire les precedents. progress recoit l'image apres le premier
+    // passage et apres chaque niveau, avec le nombre d'echantillons par pixel de bord.
+    struct Supersampling {
+        int maxGrid = 4;
+        int threshold = 24;
+    };
+    struct AdaptiveStats {
+        size_t edges = 0; // pixels sur-echantillonnes
+        size_t rays = 0;  // rayons primaires traces en tout
+    };
+    AdaptiveStats renderAdaptive(const Scene& scene, Image& img, int nbthread, const Supersampling& ss,
+                                 const std::function<void(int spp, const Image& img)>& progress = {}) {
+        const int w = scene.getWidth();
+        const int h = scene.getHeight();
+        AdaptiveStats stats;
+        Pool pool(2 * nbthread + 16);
+        pool.start(std::max(nbthread - 1, 0));
+
+        // le rendu s'accumule en float, img n'en est que la quantification (AccumBuffer::resolve)
+        AccumBuffer acc(w, h);
+
+        // 1. un rayon par pixel, en gardant la sphere vue
+        std::vector<int> ids(size_t(w) * h);
+        pool.parallel_for(0, size_t(h), 1, [&](size_t y) {
+            for (int x = 0; x < w; x++) {
+                Hit hit;
+                scene.intersect(cameraOf(scene).ray(x, int(y)), hit);
+                ids[y * w + x] = hit.index;
+                acc.set(x, y, radiance(scene, hit));
+            }
+        });
+        stats.rays = size_t(w) * h;
+        acc.resolve(img);
+        if (progress) {
+            progress(1, img);
+        }
+
+        // 2. les bords
+        std::vector<uint32_t> edges;
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < w; x++) {
+                if (isEdge(img, ids, w, h, x, y, ss.threshold)) {
+                    edges.push_back(uint32_t(y) * w + x);
+                }
+            }
+        }
+        stats.edges = edges.size();
+        if (ss.maxGrid < 2 || edges.empty()) {
+            pool.stop();
+            return stats;
+        }
+
+        // 3. les bords, directement en maxGrid, ou par niveaux qui se raffinent l'un l'autre
+        const int maxGrid = ss.maxGrid;
+        const std::vector<int> grids = progress ? refinementGrids(maxGrid) : std::vector<int>{maxGrid};
+        std::vector<Radiance> sums(edges.size()); // somme des echantillons de chaque bord
+        int prev = 0;
+        for (size_t l = 0; l < grids.size(); l++) {
+            const int grid = grids[l];
+            // un echantillon par cellule de la grille, au sous-pixel choisi par sampleIn ; les
+            // cellules qui contiennent deja celui d'une cellule du niveau precedent sont sautees
+            const int cell = maxGrid / grid;
+            const int parent = prev > 0 ? grid / prev : 0;
+            const int kept = prev > 0 ? sampleIn(grids, l - 1, maxGrid) / cell : -1;
+            const int offset = sampleIn(grids, l, maxGrid);
+            pool.parallel_for(0, edges.size(), 64, [&](size_t e) {
+                int x = int(edges[e] % w), y = int(edges[e] / w);
+                Radiance sum = sums[e];
+                for (int j = 0; j < grid; j++) {
+                    for (int i = 0; i < grid; i++) {
+                        if (parent > 0 && i % parent == kept && j % parent == kept) {
+                            continue;
+                        }
+                        sum += subpixel(scene, x, y, i * cell + offset, j * cell + offset, maxGrid);
+                    }
+                }
+                sums[e] = sum;
+                acc.set(x, y, sum * (1.0f / float(grid * grid)));
+            });
+            stats.rays += edges.size() * size_t(grid * grid - prev * prev);
+            prev = grid;
+            if (progress) {
+                acc.resolve(img);
+                progress(grid * grid, img);
+            }
+        }
+        if (!progress) {
+            acc.resolve(img);
+        }
+        pool.stop();
+        return stats;
+    }
+
+    // Rendu en flux, pour les images trop grandes pour la memoire : seules deux bandes de
+    // bandRows lignes existent. Les bandes sont rendues du bas vers le haut (l'ordre du
+    // fichier BMP), chacune en parallele (Pool::parallel_for sur ses lignes), et ecrites par
+    // une tache async pendant le rendu de la suivante. Chaque bande est rendue en float puis
+    // quantifiee d'un coup (AccumBuffer::resolveRows). Rend false si une ecriture echoue.
+    bool renderStreaming(const Scene& scene, BMPWriter& out, int bandRows, int nbthread) {
+        const int w = scene.getWidth();
+        const int h = scene.getHeight();
+        bandRows = std::clamp(bandRows, 1, h);
+        AccumBuffer acc(w, bandRows);
+        Image bands[2] = {Image(w, bandRows), Image(w, bandRows)};
+        Pool pool(2 * nbthread + 16);
+        pool.start(std::max(nbthread - 1, 0));
+        Future<bool> written; // l'ecriture de la bande precedente
+        int cur = 0;
+        for (int y1 = h; y1 > 0; y1 -= bandRows) {
+            const int y0 = std::max(0, y1 - bandRows);
+            Image& band = bands[cur];
+            pool.parallel_for(size_t(y0), size_t(y1), 1, [&](size_t y) {
+                for (int x = 0; x < w; x++) {
+                    Hit hit;
+                    scene.intersect(cameraOf(scene).ray(x, int(y)), hit);
+                    // le buffer est reutilise : ecrire aussi le fond
+                    acc.set(x, y - y0, radiance(scene, hit));
+                }
+            });
+            acc.resolveRows(0, size_t(y1 - y0), &band.pixel(0, 0));
+            // l'autre bande doit etre ecrite avant qu'on la reutilise au tour suivant
+            if (written.valid() && !written.get()) {
+                return false;
+            }
+            written = pool.async([&out, &band, y0, y1] { return out.writeRows(y0, y1 - y0, &band.pixel(0, 0)); });
+            cur ^= 1;
+        }
+        bool ok = !written.valid() || written.get();
+        pool.stop();
+        return ok;
+    }
+
+    // le rayon du sous-pixel (i, j) d'une grille de grid x grid sur le pixel (x, y), par son centre
+    Radiance subpixel(const Scene& scene, int x, int y, int i, int j, int grid) const {
+        double sx = x + (i + 0.5) / grid - 0.5;
+        double sy = y + (j + 0.5) / grid - 0.5;
+        Hit hit;
+        scene.intersect(cameraOf(scene).ray(sx, sy), hit);
+        return radiance(scene, hit);
+    }
+
+    // Les niveaux de renderAdaptive avec progress : chaque grille divise la suivante, la derniere
+    // etant maxGrid. On remonte de maxGrid en divisant par son plus petit facteur premier :
+    // 8 -> 2, 4, 8 ; 6 -> 3, 6 ; 5 -> 5.
+    static std::vector<int> refinementGrids(int maxGrid) {
+        std::vector<int> grids;
+        for (int g = maxGrid; g > 1;) {
+            grids.insert(grids.begin(), g);
+            int p = 2;
+            while (g % p != 0) {
+                p++;
+            }
+            g /= p;
+        }
+        return grids;
+    }
+
+    // Le sous-pixel de maxGrid echantillonne dans une cellule du niveau l, en sous-pixels depuis
+    // son coin : un des echantillons de ses cellules filles au niveau l + 1 (grilles emboitees),
+    // celle du milieu pour un facteur impair, sinon alternativement la premiere et la seconde
+    // moitie d'un niveau a l'autre, pour rester pres du centre.
+    static int sampleIn(const std::vector<int>& grids, size_t l, int maxGrid) {
+        if (l + 1 >= grids.size()) {
+            return 0;
+        }
+        const int r = grids[l + 1] / grids[l];
+        const int child = r % 2 ? r / 2 : int(l % 2 == 0 ? r / 2 : r / 2 - 1);
+        return child * (maxGrid / grids[l + 1]) + sampleIn(grids, l + 1, maxGrid);
+    }
+
+    // la couleur vue par un rayon, le fond (blanc, comme Color()) s'il ne touche rien
+    static Radiance radiance(const Scene& scene, const Hit& hit) {
+        return hit.found() ? scene.computeRadiance(hit) : Radiance(Color());
+    }
+
+    // les lignes [y0, y1), en entier
+    void renderRows(const Scene& scene, Image& img, int y0, int y1) {
+        renderBlock(scene, img, 0, y0, scene.getWidth(), y1);
+    }
+
+    // le rectangle [x0, x1) x [y0, y1)
+    // Par paquets : 2x2 pixels tant qu'il reste deux lignes, 4x1 sur une ligne seule (modes
+    // par ligne), les rayons d'un paquet etant traces ensemble (Scene::intersectPacket).
+    void renderBlock(const Scene& scene, Image& img, int x0, int y0, int x1, int y1) {
+        if (!packets) {
+            // pour chaque pixel, calculer sa couleur ; x a l'interieur, dans l'ordre de la memoire
+            for (int y = y0; y < y1; y++) {
+                for (int x = x0; x < x1; x++) {
+                    renderPixel(scene, img, x, y);
+                }
+            }
+            return;
+        }
+        const Camera& cam = cameraOf(scene);
+        for (int y = y0; y < y1; y += 2) {
+            const int rows = std::min(2, y1 - y);
+            const int cols = rows == 2 ? 2 : 4;
+            for (int x = x0; x < x1; x += cols) {
+                Ray rays[4];
+                int xs[4], ys[4];
+                Hit hits[4];
+                int n = 0;
+                for (int dy = 0; dy < rows; dy++) {
+                    for (int dx = 0; dx < cols && x + dx < x1; dx++) {
+                        xs[n] = x + dx;
+                        ys[n] = y + dy;
+                        rays[n] = cam.ray(x + dx, y + dy);
+                        n++;
+                    }
+                }
+                scene.intersectPacket(rays, n, hits);
+                for (int i = 0; i < n; i++) {
+                    shade(scene, img, xs[i], ys[i], hits[i]);
+                }
+            }
+        }
+    }
+
+    // un pixel
+    void renderPixel(const Scene& scene, Image& img, int x, int y) const {
+        // on tire un rayon de l'observateur vers le point de l'ecran du pixel,
+        // calcule a la demande par la camera
+        Ray ray = cameraOf(scene).ray(x, y);
+
+        Hit hit;
+        scene.intersect(ray, hit);
+        shade(scene, img, x, y, hit);
+    }
+
+    // la couleur du pixel (x, y), dont le rayon a donne hit
+    static void shade(const Scene& scene, Image& img, int x, int y, const Hit& hit) {
+        if (!hit.found()) {
+            // keep background color
+            return;
+        }
+        // pixel prend la couleur de l'objet, eclairee
+        Color finalcolor = scene.computeColor(hit);
+        // mettre a jour la couleur du pixel dans l'image finale.
+        img.pixel(x, y) = finalcolor;
+    }
+
+private:
+    const Camera& cameraOf(const Scene& scene) const {
+        return camera ? *camera : scene.getCamera();
+    }
+
+    static bool isEdge(const Image& img, const std::vector<int>& ids, int w, int h, int x, int y, int threshold) {
+        const Color& c = img.pixel(x, y);
+        const int id = ids[size_t(y) * w + x];
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                int nx = x + dx, ny = y + dy;
+                if ((dx == 0 && dy == 0) || nx < 0 || ny < 0 || nx >= w || ny >= h) {
                     continue;
-                } else {
-                    const Sphere& obj = scene.getObject(targetSphere);
-                    // pixel prend la couleur de l'objet
-                    Color finalcolor = scene.computeColor(obj, ray);
-                    // mettre a jour la couleur du pixel dans l'image finale.
-                    img.pixel(x, y) = finalcolor;
+                }
+                if (ids[size_t(ny) * w + nx] != id) {
+                    return true;
+                }
+                const Color& o = img.pixel(nx, ny);
+                if (std::abs(c.getR() - o.getR()) > threshold || std::abs(c.getG() - o.getG()) > threshold ||
+                    std::abs(c.getB() - o.getB()) > threshold) {
+                    return true;
                 }
             }
         }
+        return false;
     }
+
+    class PixelJob : public Job {
+        const Renderer& renderer;
+        const Scene& scene;
+        Image& img;
+        int x, y;
+    public:
+        PixelJob(const Renderer& renderer, const Scene& scene, Image& img, int x, int y)
+            : renderer(renderer), scene(scene), img(img), x(x), y(y) {}
+        void run() override {
+            renderer.renderPixel(scene, img, x, y);
+        }
+    };
+
+    class LineJob : public Job {
+        Renderer& renderer;
+        const Scene& scene;
+        Image& img;
+        int y;
+    public:
+        LineJob(Renderer& renderer, const Scene& scene, Image& img, int y) : renderer(renderer), scene(scene), img(img), y(y) {}
+        void run() override {
+            renderer.renderRows(scene, img, y, y + 1);
+        }
+    };
 };
 
-} // namespace pr
\ No newline at end of file
+} // namespace pr
@@ -2,131 +2,228 @@
 
 #include "Vec3D.h"
 #include "Sphere.h"
+#include "BVH.h"
+#include "SphereSoA.h"
+#include "Camera.h"
+#include "Hit.h"
+#include "AccumBuffer.h"
+#include <memory>
+#include <mutex>
 #include <vector>
 
 namespace pr {
 
-// une scene basique, la camera est fixe
+// une scene basique, la camera est fixe (un Renderer peut en prendre une autre, cf. Renderer::setCamera)
 // porte un ensemble d'objets, des spheres a ce stade
 class Scene {
 	// les objets
 	std::vector<Sphere> objects;
-	// la camera 
-	Vec3D camposition;
-	// son angle de vue, vecteur unitaire dans la direction de la vue
-	Vec3D viewDir;
-	// suppose fixe actuellement
-
+	// la camera, et l'ecran devant elle
+	Camera camera;
 	// largeur de l'ecran en pixels : controle la resolution
 	// pas la largeur du champ
 	int width;
 	int height;
 	// les lumieres
 	std::vector<Vec3D> lights;
+	// centres et rayons de objects, pour le parcours lineaire vectorise
+	SphereSoA soa;
+	// hierarchie englobante sur objects, vide tant que buildBVH n'a pas ete appele
+	BVH bvh;
+	// kernel d'intersection rayon/spheres
+	Isect isect = Isect::Double;
 public :
 	// les points d'un ecran 3D 
 	using screen_t = std::vector<std::vector<Vec3D>>;
 private :
-	// l'ecran, calcule a partir de la position et l'angle
-	std::vector<std::vector<Vec3D> > screen;
+	// l'ecran precalcule, seulement si getScreenPoints est appele : 24 octets par pixel
+	struct ScreenCache {
+		std::once_flag once;
+		screen_t points;
+	};
+	std::unique_ptr<ScreenCache> screen;
 public:
 	// une scene, on donne seulement la resolution
+	// on positionne en dur les positions et champ de vue (cf. Camera)
 	Scene(int width=800, int height=600)
-		// on positionne en dur les positions et champ de vue
-		:camposition(0,0,-1000),viewDir(0,0,1),width(width),height(height),screen() {
-		// distance from camera to screen
-		double distance = 1000.0;
-		Vec3D screenCenter = camposition + distance * viewDir;
-		// up vector
-		Vec3D up0(0, 1, 0);
-		// right vector
-		Vec3D right = (viewDir * up0).normalize();
-		// re-orthogonalize up
-		Vec3D up = (right * viewDir).normalize();
-
-		double W = 400;
-		double H = (W * height) / width;
-		double pixelSizeX = W / width;
-		double pixelSizeY = H / height;
-
-		// compute screen points
-		screen.resize(height);
-		for (int y = 0; y < height; y++) {
-			screen[y].reserve(width);
-			for (int x = 0; x < width; x++) {
-				Vec3D offset = (x - width / 2.0) * pixelSizeX * right + (y - height / 2.0) * pixelSizeY * up;
-				Vec3D pixelPos = screenCenter + offset;
-				screen[y].emplace_back(pixelPos);
-			}
-		}
-	}
+		:camera(width, height),width(width),height(height),screen(std::make_unique<ScreenCache>()) {}
 	// ajoute un objet a la scene
 	void add (const Sphere & s) {
+		soa.push_back(s, uint32_t(objects.size()));
 		objects.push_back(s);
+		// la BVH ne couvre plus tous les objets : retour au parcours lineaire
+		bvh = BVH();
+	}
+	// reserve la place de n objets, avant de les ajouter un a un
+	void reserve(size_t n) {
+		objects.reserve(n);
+		soa.reserve(n);
+	}
+	// construit la BVH sur les objets actuels : a appeler une fois la scene complete
+	void buildBVH() {
+		bvh = BVH(objects);
 	}
+	const BVH & getBVH() const { return bvh; }
+	// choix du kernel d'intersection (cf. SphereSoA.h)
+	void setIsect(Isect k) { isect = k; }
+	Isect getIsect() const { return isect; }
 	// ajoute une lumiere a la scene
 	void addLight (const Vec3D & l) {
 		lights.push_back(l);
 	}
 
-	// les points de l'ecran par lesquels passent les rayons
-	const screen_t & getScreenPoints() const { return screen; }
+	// les points de l'ecran par lesquels passent les rayons.
+	// Compatibilite : calcules et gardes au premier appel (thread safe), O(pixels) en memoire.
+	// Le rendu utilise plutot getCamera().ray(x, y), sans memoire par pixel.
+	const screen_t & getScreenPoints() const {
+		std::call_once(screen->once, [this] {
+			screen->points.resize(height);
+			for (int y = 0; y < height; y++) {
+				screen->points[y].reserve(width);
+				for (int x = 0; x < width; x++) {
+					screen->points[y].push_back(camera.screenPoint(x, y));
+				}
+			}
+		});
+		return screen->points;
+	}
+	// la camera
+	const Camera & getCamera() const { return camera; }
 	// resolution en pixels
 	int getHeight() const { return height ;}
 	int getWidth() const { return width ;}
 	// la camera (const)
-	const Vec3D & getCameraPos() const { return camposition ; }
+	const Vec3D & getCameraPos() const { return camera.getPosition() ; }
 
 	// return the index of the closest object in the scene that intersects "ray"
 	// or -1 if the ray does not intersect any object.
 	int findClosestInter(const Ray & ray) const {
-		auto minz = std::numeric_limits<double>::max();
-		int targetSphere = -1;
-		int index = 0;
-		for (const auto & obj : objects) {
-			// rend la distance de l'objet a la camera
-			auto zinter = obj.intersects(ray);
-			// si intersection plus proche  ?
-			if (zinter < minz) {
-				minz = zinter;
-				targetSphere = index;
+		// direction normalisee une fois pour toutes les spheres testees
+		RayQuery q(ray);
+		if (!bvh.empty()) {
+			double t;
+			return bvh.closest(q, t, isect);
+		}
+		return findClosestInterLinear(q);
+	}
+
+	// the closest intersection of ray with the scene, with its point and normal ; false if none
+	bool intersect(const Ray & ray, Hit & hit) const {
+		RayQuery q(ray);
+		hit = Hit();
+		if (!bvh.empty()) {
+			hit.index = bvh.closest(q, hit.t, isect);
+		} else {
+			soa.closest(q, 0, soa.size(), hit.t, hit.index, isect);
+		}
+		complete(q, hit);
+		return hit.found();
+	}
+
+	// intersect for n <= 4 neighbouring rays (2x2 or 4x1 pixels) : hits[i] for rays[i].
+	// Traced as one packet with the AVX2 double kernel when the rays go the same way, which
+	// gives the same hits as intersect ; else (or without AVX2) one by one.
+	void intersectPacket(const Ray * rays, int n, Hit * hits) const {
+		RayQuery qs[RayPacket::N];
+		for (int i = 0; i < n; i++) {
+			qs[i] = RayQuery(rays[i]);
+		}
+#if PR_SIMD_AVX2
+		RayPacket p(qs, n);
+		if (isect == Isect::Double && SphereSoA::hasAVX2() && p.coherent()) {
+			double tbest[RayPacket::N];
+			int targets[RayPacket::N];
+			if (!bvh.empty()) {
+				bvh.closestPacket(p, tbest, targets);
+			} else {
+				for (int i = 0; i < RayPacket::N; i++) {
+					tbest[i] = std::numeric_limits<double>::max();
+					targets[i] = -1;
+				}
+				soa.closestPacket(p, p.full(), 0, soa.size(), tbest, targets);
+			}
+			for (int i = 0; i < n; i++) {
+				hits[i] = Hit();
+				hits[i].t = tbest[i];
+				hits[i].index = targets[i];
+				complete(qs[i], hits[i]);
 			}
-			index++;
+			return;
+		}
+#endif
+		for (int i = 0; i < n; i++) {
+			intersect(rays[i], hits[i]);
+		}
+	}
+
+	// true if some object lies between the light and point : the shadow ray goes from the
+	// light to the point, and stops at the first object found (any hit), closest or not
+	bool inShadow(const Vec3D & light, const Vec3D & point) const {
+		RayQuery q(Ray(light, point));
+		//  epsilon 1e-4 for double issues : the point itself is not an obstacle
+		double tmax = (point - light).length() - 1e-4;
+		if (!bvh.empty()) {
+			return bvh.occluded(q, tmax, -1, isect);
 		}
+		return soa.any(q, 0, soa.size(), tmax, -1, isect);
+	}
+
+	// same, testing every object : O(objects) per ray, a few at a time with SIMD
+	int findClosestInterLinear(const RayQuery & q) const {
+		double minz = std::numeric_limits<double>::max();
+		int targetSphere = -1;
+		soa.closest(q, 0, soa.size(), minz, targetSphere, isect);
 		return targetSphere;
 	}
 
 	// get an object by index
 	const Sphere& getObject(int index) const { return objects[index]; }
+	// tous les objets, et les lumieres
+	const std::vector<Sphere>& getObjects() const { return objects; }
+	const std::vector<Vec3D>& getLights() const { return lights; }
 
 	// Calcule l'angle d'incidence du rayon à la sphere, cumule l'éclairage des lumières
-	// En déduit la couleur d'un pixel de l'écran.
-	Color computeColor(const Sphere & obj, const Ray & ray) const {
-		Color finalcolor = obj.getColor();
+	// En déduit la couleur (lineaire, non saturee) d'un pixel de l'écran.
+	// hit : l'intersection du rayon primaire, calculee par intersect
+	Radiance computeRadiance(const Hit & hit) const {
+		Radiance base(objects[hit.index].getColor());
 
-		// calcul du rayon et de sa normale a la sphere
-		// on prend le vecteur de la camera vers le point de l'ecran (dest - origine)
-		// on le normalise a la longueur 1, on multiplie par la distance à l'intersection
-		Vec3D rayInter = (ray.dest - ray.ori).normalize() * obj.intersects(ray);
-		// le point d'intersection
-		Vec3D intersection = rayInter + camposition;
-		// la normale a la sphere au point d'intersection donne l'angle pour la lumiere
-		Vec3D normal = obj.getNormale(intersection);
+		// le point d'intersection et la normale a la sphere en ce point (qui donne l'angle pour
+		// la lumiere) sont dans hit
+		const Vec3D & intersection = hit.point;
+		const Vec3D & normal = hit.normal;
 		// le niveau d'eclairage total contribue par les lumieres 0 sombre 1 total lumiere
 		double dt = 0;
 		// modifier par l'eclairage la couleur
 		for (const auto & light : lights) {
 			// le vecteur de la lumiere au point d'intersection
 			Vec3D tolight = (light - intersection);
-			// si on est du bon cote de la sphere, i.e. le rayon n'intersecte pas avant de l'autre cote
-			if (obj.intersects(Ray(light,intersection)) >= tolight.length() - 1e-4 ) {   //  epsilon 1e-4 for double issues
+			// eclaire si rien ne s'interpose entre la lumiere et le point : ni l'autre cote de
+			// cette sphere, ni une autre sphere (ombre portee)
+			if (!inShadow(light, intersection)) {
 				dt += tolight.normalize() & normal ; // l'angle (scalaire) donne la puissance de la lumiere reflechie
 			}
 		}
-		// eclairage total
-		finalcolor = finalcolor * dt + finalcolor * 0.2; // *0.2 = lumiere speculaire ambiante
+		// eclairage total, plafonne a 1 ; + 0.2 de lumiere ambiante
+		return base * float(std::clamp(dt, 0.0, 1.0) + 0.2);
+	}
 
-		return finalcolor;
+	// la meme, quantifiee en Color : un seul arrondi, a la fin
+	Color computeColor(const Hit & hit) const {
+		Radiance c = computeRadiance(hit);
+		return Color(AccumBuffer::quantize(c.r), AccumBuffer::quantize(c.g), AccumBuffer::quantize(c.b));
+	}
+
+private:
+	// point and normal of a hit found along q
+	void complete(const RayQuery & q, Hit & hit) const {
+		if (!hit.found()) {
+			return;
+		}
+		// la direction normalisee, multipliee par la distance a l'intersection, depuis l'origine
+		Vec3D dir(q.d[0], q.d[1], q.d[2]);
+		hit.point = dir * hit.t + Vec3D(q.o[0], q.o[1], q.o[2]);
+		hit.normal = objects[hit.index].getNormale(hit.point);
 	}
 };
 
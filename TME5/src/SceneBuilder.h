@@ -4,16 +4,53 @@
 #include "Vec3D.h"
 #include "Sphere.h"
 #include "Color.h"
+#include "Pool.h"
 #include "util/mtrand.h"
+#include <algorithm>
+#include <vector>
 
 namespace pr {
 
+// les spheres aleatoires sont tirees par blocs de RANDOM_CHUNK
+constexpr size_t RANDOM_CHUNK = 4096;
+
 // construit une scene aleatoire avec spheres et lumieres
-Scene buildRandomScene(int width, int height, int num_spheres = 250) {
+// bvh : construire la hierarchie englobante, sinon chaque rayon teste toutes les spheres
+// nbthread : threads qui tirent les spheres. Le bloc c est tire du flux c (c sauts, cf.
+// Xoshiro256::jump) d'une graine prise au generateur du thread appelant : la scene ne depend
+// que de ce generateur (cf. mtseed), pas du nombre de threads.
+inline Scene buildRandomScene(int width, int height, int num_spheres = 250, bool bvh = true, int nbthread = 1) {
 	Scene scene(width, height);
 	// Nombre de spheres (rend le probleme plus dur)
-	for (int i = 0; i < num_spheres; i++) {
-		scene.add(Sphere::random());
+	const size_t n = size_t(num_spheres);
+	const size_t chunks = (n + RANDOM_CHUNK - 1) / RANDOM_CHUNK;
+	std::vector<Xoshiro256> streams;
+	streams.reserve(chunks);
+	Xoshiro256 rng(threadRng()());
+	for (size_t c = 0; c < chunks; c++) {
+		streams.push_back(rng);
+		rng.jump();
+	}
+	std::vector<Sphere> spheres(n);
+	auto draw = [&](size_t c) {
+		for (size_t i = c * RANDOM_CHUNK; i < std::min(n, (c + 1) * RANDOM_CHUNK); i++) {
+			spheres[i] = Sphere::random(streams[c]);
+		}
+	};
+	if (nbthread > 1 && chunks > 1) {
+		Pool pool(2 * nbthread + 16);
+		// l'appelant participe a parallel_for : nbthread - 1 workers, comme les modes de Renderer
+		pool.start(std::max(nbthread - 1, 0));
+		pool.parallel_for(0, chunks, 1, draw);
+		pool.stop();
+	} else {
+		for (size_t c = 0; c < chunks; c++) {
+			draw(c);
+		}
+	}
+	scene.reserve(n + 2);
+	for (const Sphere & s : spheres) {
+		scene.add(s);
 	}
 	// quelques spheres de plus pour ajouter du gout a la scene
 	scene.add(Sphere(Vec3D(50, 50, 40), 15.0, Colors::red));
@@ -24,6 +61,10 @@ Scene buildRandomScene(int width, int height, int num_spheres = 250) {
 	scene.addLight(Vec3D(50, 50, 120));
 	scene.addLight(Vec3D(200, 0, 120));
 
+	if (bvh) {
+		scene.buildBVH();
+	}
+
 	return scene;
 }
 
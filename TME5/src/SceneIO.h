@@ -0,0 +1,321 @@
+#pragma once
+
+#include "Scene.h"
+#include "Sphere.h"
+#include "Vec3D.h"
+#include "Color.h"
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace pr {
+
+// Sauvegarde et chargement des spheres et lumieres d'une scene, pour rendre la meme scene d'une
+// execution (ou d'une machine) a l'autre. La resolution et la camera n'en font pas partie.
+//
+// Format texte, pour les humains : une entree par ligne, '#' commente la fin de ligne
+//   prscene 1
+//   light x y z
+//   sphere x y z radius r g b        (couleur 0..255 par composante)
+// Les doubles sont ecrits au plus court qui relit exactement la meme valeur.
+//
+// Format binaire, le cache des grosses scenes : l'en-tete, puis les lumieres, puis les spheres,
+// en enregistrements de taille fixe, dans l'ordre des octets de la machine (little endian).
+// Le fichier est projete en memoire (mmap) et relu sans analyse ni copie intermediaire.
+namespace sceneio {
+
+// 24 octets, aligne sur 8 : les tableaux qui suivent le sont aussi
+struct BinaryHeader {
+	char magic[8] = {'P', 'R', 'S', 'C', 'E', 'N', 'E', 'B'};
+	uint32_t version = 1;
+	uint32_t lightCount = 0;
+	uint64_t sphereCount = 0;
+};
+struct LightRecord {
+	double position[3];
+};
+struct SphereRecord {
+	double centre[3];
+	double radius;
+	uint8_t rgb[3];
+	uint8_t pad[5] = {0, 0, 0, 0, 0};
+};
+static_assert(sizeof(BinaryHeader) == 24, "BinaryHeader must be 24 bytes");
+static_assert(sizeof(LightRecord) == 24, "LightRecord must be 24 bytes");
+static_assert(sizeof(SphereRecord) == 40, "SphereRecord must be 40 bytes");
+
+inline bool isBinaryPath(const std::string & path) {
+	return path.size() >= 4 && path.compare(path.size() - 4, 4, ".bin") == 0;
+}
+
+// un fichier projete en lecture seule, demappe a la destruction. Un fichier vide est lisible,
+// sans projection (mmap refuse une taille nulle) : data() est alors une chaine vide.
+class MappedFile {
+	void * data_ = MAP_FAILED;
+	size_t size_ = 0;
+	bool ok_ = false;
+public:
+	explicit MappedFile(const std::string & path) {
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return;
+		}
+		struct stat st;
+		if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+			size_ = size_t(st.st_size);
+			if (size_ == 0) {
+				ok_ = true;
+			} else {
+				data_ = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (data_ != MAP_FAILED) {
+					ok_ = true;
+					// lu une seule fois, du debut a la fin
+					::madvise(data_, size_, MADV_SEQUENTIAL);
+				}
+			}
+		}
+		// la projection survit a la fermeture du descripteur
+		::close(fd);
+	}
+	MappedFile(const MappedFile &) = delete;
+	MappedFile & operator=(const MappedFile &) = delete;
+	~MappedFile() {
+		if (data_ != MAP_FAILED) {
+			::munmap(data_, size_);
+		}
+	}
+	bool ok() const { return ok_; }
+	const char * data() const { return data_ != MAP_FAILED ? static_cast<const char *>(data_) : ""; }
+	size_t size() const { return size_; }
+};
+
+// les valeurs d'un fichier ne sont pas sures : pas d'infini ni de NaN, qui empoisonneraient
+// la BVH et les intersections, ni de rayon nul ou negatif
+inline bool validLight(double x, double y, double z) {
+	return std::isfinite(x) && std::isfinite(y) && std::isfinite(z);
+}
+inline bool validSphere(double x, double y, double z, double radius) {
+	return validLight(x, y, z) && std::isfinite(radius) && radius > 0;
+}
+
+inline bool loadBinary(const MappedFile & file, Scene & scene, std::string & error) {
+	BinaryHeader h;
+	if (file.size() < sizeof(h)) {
+		error = "truncated header";
+		return false;
+	}
+	std::memcpy(&h, file.data(), sizeof(h));
+	if (h.version != 1) {
+		error = "unsupported binary version " + std::to_string(h.version);
+		return false;
+	}
+	// les comptes viennent du fichier : les borner par les octets presents avant de multiplier,
+	// pour qu'un en-tete forge ne fasse pas deborder la taille attendue
+	const size_t body = file.size() - sizeof(h);
+	if (h.lightCount > body / sizeof(LightRecord)
+	    || h.sphereCount > (body - h.lightCount * sizeof(LightRecord)) / sizeof(SphereRecord)
+	    || body != h.lightCount * sizeof(LightRecord) + h.sphereCount * sizeof(SphereRecord)) {
+		error = "size does not match " + std::to_string(h.lightCount) + " lights and " + std::to_string(h.sphereCount) + " spheres";
+		return false;
+	}
+	// mmap rend une adresse alignee sur une page, et les enregistrements sont alignes sur 8
+	const auto * lights = reinterpret_cast<const LightRecord *>(file.data() + sizeof(h));
+	const auto * spheres = reinterpret_cast<const SphereRecord *>(lights + h.lightCount);
+	// tout verifier avant d'ajouter quoi que ce soit a scene
+	for (size_t i = 0; i < h.lightCount; i++) {
+		const double * p = lights[i].position;
+		if (!validLight(p[0], p[1], p[2])) {
+			error = "light " + std::to_string(i) + ": non-finite position";
+			return false;
+		}
+	}
+	for (size_t i = 0; i < h.sphereCount; i++) {
+		const SphereRecord & s = spheres[i];
+		if (!validSphere(s.centre[0], s.centre[1], s.centre[2], s.radius)) {
+			error = "sphere " + std::to_string(i) + ": non-finite centre, or radius not positive";
+			return false;
+		}
+	}
+	scene.reserve(scene.getObjects().size() + h.sphereCount);
+	for (size_t i = 0; i < h.sphereCount; i++) {
+		const SphereRecord & s = spheres[i];
+		scene.add(Sphere(Vec3D(s.centre[0], s.centre[1], s.centre[2]), s.radius, Color(s.rgb[0], s.rgb[1], s.rgb[2])));
+	}
+	for (size_t i = 0; i < h.lightCount; i++) {
+		scene.addLight(Vec3D(lights[i].position[0], lights[i].position[1], lights[i].position[2]));
+	}
+	return true;
+}
+
+// decoupe une ligne en mots separes par des blancs
+class Tokens {
+	std::string_view rest;
+public:
+	explicit Tokens(std::string_view line) : rest(line) {}
+	bool next(std::string_view & word) {
+		size_t b = rest.find_first_not_of(" \t\r");
+		if (b == std::string_view::npos) {
+			return false;
+		}
+		size_t e = rest.find_first_of(" \t\r", b);
+		word = rest.substr(b, e == std::string_view::npos ? std::string_view::npos : e - b);
+		rest = e == std::string_view::npos ? std::string_view() : rest.substr(e);
+		return true;
+	}
+	template <typename T>
+	bool number(T & v) {
+		std::string_view w;
+		if (!next(w)) {
+			return false;
+		}
+		auto [end, ec] = std::from_chars(w.data(), w.data() + w.size(), v);
+		return ec == std::errc() && end == w.data() + w.size();
+	}
+	bool atEnd() {
+		std::string_view w;
+		return !next(w);
+	}
+};
+
+inline bool loadText(const MappedFile & file, Scene & scene, std::string & error) {
+	std::string_view text(file.data(), file.size());
+	bool versioned = false;
+	size_t lineno = 0;
+	while (!text.empty()) {
+		size_t eol = text.find('\n');
+		std::string_view line = text.substr(0, eol);
+		text = eol == std::string_view::npos ? std::string_view() : text.substr(eol + 1);
+		lineno++;
+		line = line.substr(0, line.find('#'));
+
+		Tokens tok(line);
+		std::string_view key;
+		if (!tok.next(key)) {
+			continue;
+		}
+		bool ok;
+		if (!versioned) {
+			int version = 0;
+			ok = key == "prscene" && tok.number(version) && version == 1;
+			versioned = ok;
+		} else if (key == "light") {
+			double x, y, z;
+			ok = tok.number(x) && tok.number(y) && tok.number(z) && validLight(x, y, z);
+			if (ok) {
+				scene.addLight(Vec3D(x, y, z));
+			}
+		} else if (key == "sphere") {
+			double x, y, z, radius;
+			int r, g, b;
+			ok = tok.number(x) && tok.number(y) && tok.number(z) && tok.number(radius) && tok.number(r) && tok.number(g)
+			     && tok.number(b) && r >= 0 && r < 256 && g >= 0 && g < 256 && b >= 0 && b < 256
+			     && validSphere(x, y, z, radius);
+			if (ok) {
+				scene.add(Sphere(Vec3D(x, y, z), radius, Color(r, g, b)));
+			}
+		} else {
+			ok = false;
+		}
+		if (!ok || !tok.atEnd()) {
+			error = "line " + std::to_string(lineno) + ": " + (versioned ? "malformed entry" : "expected 'prscene 1'");
+			return false;
+		}
+	}
+	if (!versioned) {
+		error = "expected 'prscene 1'";
+		return false;
+	}
+	return true;
+}
+
+inline void appendNumber(std::string & out, double v) {
+	char buf[32];
+	auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), v);
+	out.push_back(' ');
+	out.append(buf, end);
+}
+
+inline bool saveText(const Scene & scene, const std::string & path) {
+	std::ofstream out(path, std::ios::binary);
+	std::string buf = "prscene 1\n";
+	for (const Vec3D & l : scene.getLights()) {
+		buf += "light";
+		appendNumber(buf, l.getX());
+		appendNumber(buf, l.getY());
+		appendNumber(buf, l.getZ());
+		buf += '\n';
+	}
+	for (const Sphere & s : scene.getObjects()) {
+		buf += "sphere";
+		appendNumber(buf, s.getCentre().getX());
+		appendNumber(buf, s.getCentre().getY());
+		appendNumber(buf, s.getCentre().getZ());
+		appendNumber(buf, s.getRadius());
+		for (int c : {s.getColor().getR(), s.getColor().getG(), s.getColor().getB()}) {
+			buf += ' ';
+			buf += std::to_string(c);
+		}
+		buf += '\n';
+		// par morceaux, pour ne pas tenir tout le texte d'une grosse scene
+		if (buf.size() > (1 << 20)) {
+			out.write(buf.data(), buf.size());
+			buf.clear();
+		}
+	}
+	out.write(buf.data(), buf.size());
+	out.close();
+	return bool(out);
+}
+
+inline bool saveBinary(const Scene & scene, const std::string & path) {
+	std::ofstream out(path, std::ios::binary);
+	BinaryHeader h;
+	h.lightCount = uint32_t(scene.getLights().size());
+	h.sphereCount = scene.getObjects().size();
+	out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+	for (const Vec3D & l : scene.getLights()) {
+		LightRecord r{{l.getX(), l.getY(), l.getZ()}};
+		out.write(reinterpret_cast<const char *>(&r), sizeof(r));
+	}
+	for (const Sphere & s : scene.getObjects()) {
+		const Vec3D & c = s.getCentre();
+		SphereRecord r{{c.getX(), c.getY(), c.getZ()}, s.getRadius(), {s.getColor().getR(), s.getColor().getG(), s.getColor().getB()}};
+		out.write(reinterpret_cast<const char *>(&r), sizeof(r));
+	}
+	out.close();
+	return bool(out);
+}
+
+} // namespace sceneio
+
+// ajoute a scene les spheres et lumieres du fichier path, texte ou binaire (reconnu a son en-tete).
+// La BVH n'est pas construite : a faire une fois la scene chargee (Scene::buildBVH).
+// false, et la raison dans error, si le fichier est illisible ou mal forme
+inline bool loadScene(const std::string & path, Scene & scene, std::string & error) {
+	sceneio::MappedFile file(path);
+	if (!file.ok()) {
+		error = "cannot read file";
+		return false;
+	}
+	sceneio::BinaryHeader h;
+	if (file.size() >= sizeof(h) && std::memcmp(file.data(), h.magic, sizeof(h.magic)) == 0) {
+		return sceneio::loadBinary(file, scene, error);
+	}
+	return sceneio::loadText(file, scene, error);
+}
+
+// ecrit les spheres et lumieres de scene dans path : en binaire si path finit par ".bin",
+// en texte sinon. false si l'ecriture a echoue
+inline bool saveScene(const Scene & scene, const std::string & path) {
+	return sceneio::isBinaryPath(path) ? sceneio::saveBinary(scene, path) : sceneio::saveText(scene, path);
+}
+
+} // namespace pr
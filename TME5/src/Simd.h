@@ -0,0 +1,28 @@
+#pragma once
+
+// Support AVX2 commun aux kernels SIMD (SphereSoA, BVH, AccumBuffer).
+// Le code AVX2 est compile pour cette cible fonction par fonction (PR_TARGET_AVX2), sans
+// changer les options de compilation du reste du programme, et n'est appele que si le
+// processeur le supporte (cpuHasAVX2) : le meme binaire tourne partout.
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define PR_SIMD_AVX2 1
+#define PR_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define PR_SIMD_AVX2 0
+#define PR_TARGET_AVX2
+#endif
+
+namespace pr {
+
+// true si le processeur supporte AVX2
+inline bool cpuHasAVX2() {
+#if PR_SIMD_AVX2
+	static const bool has = __builtin_cpu_supports("avx2");
+	return has;
+#else
+	return false;
+#endif
+}
+
+} /* namespace pr */
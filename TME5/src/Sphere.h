@@ -55,10 +55,20 @@ public:
 	}
 
 	const Color & getColor () const {return color ;}
+	const Vec3D & getCentre () const {return centre ;}
+	double getRadius () const {return radius ;}
 
 	static Sphere random() {
-		return Sphere(Vec3D(mtrand(-200, 200), mtrand(-200, 200), 300 + mtrand(-100, 200)),
-					  mtrand(3, 34), Colors::random());
+		return random(threadRng());
+	}
+	// la meme, tiree d'un generateur donne (un flux par tache en parallele)
+	static Sphere random(Xoshiro256 & rng) {
+		// un tirage par instruction : l'ordre des tirages ne depend pas du compilateur
+		double x = rng.range(-200, 200);
+		double y = rng.range(-200, 200);
+		double z = 300 + rng.range(-100, 200);
+		double radius = rng.range(3, 34);
+		return Sphere(Vec3D(x, y, z), radius, Colors::random(rng));
 	}
 };
 
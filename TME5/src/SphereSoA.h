@@ -0,0 +1,386 @@
+#pragma once
+
+#include "Sphere.h"
+#include "Ray.h"
+#include "Vec3D.h"
+#include "Simd.h"
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace pr {
+
+// kernel d'intersection rayon/spheres
+//  - Scalar : une sphere a la fois, en double ;
+//  - Double : AVX2, 4 spheres par instruction, en double : meme resultat que Scalar au bit pres ;
+//  - Float : AVX2, 8 spheres par instruction, en float : deux fois plus de spheres par
+//    instruction, mais l'image peut differer de quelques pixels au bord des spheres.
+// Sans AVX2 (autre architecture, ou processeur qui ne le supporte pas), Double et Float
+// retombent sur Scalar.
+enum class Isect { Scalar, Double, Float };
+
+// un rayon prepare pour les requetes : direction normalisee une seule fois par rayon,
+// au lieu d'une fois par sphere testee comme dans Sphere::intersects
+struct RayQuery {
+	double o[3];
+	double d[3];
+	RayQuery() = default;
+	explicit RayQuery(const Ray & ray) {
+		Vec3D dir = ray.direction();
+		for (int a = 0; a < 3; a++) {
+			o[a] = ray.ori[a];
+			d[a] = dir[a];
+		}
+	}
+};
+
+// Un paquet de 4 rayons voisins (2x2 ou 4x1 pixels), en SoA : une lane AVX2 par rayon.
+// Les lanes au dela de count repetent le rayon 0 et sont hors du masque full().
+struct RayPacket {
+	static constexpr int N = 4;
+	alignas(32) double o[3][N];
+	alignas(32) double d[3][N];
+	int count;
+
+	RayPacket(const RayQuery * rays, int n) : count(n) {
+		for (int l = 0; l < N; l++) {
+			const RayQuery & q = rays[l < n ? l : 0];
+			for (int a = 0; a < 3; a++) {
+				o[a][l] = q.o[a];
+				d[a][l] = q.d[a];
+			}
+		}
+	}
+	int full() const { return (1 << count) - 1; }
+	RayQuery lane(int l) const {
+		RayQuery q;
+		for (int a = 0; a < 3; a++) {
+			q.o[a] = o[a][l];
+			q.d[a] = d[a][l];
+		}
+		return q;
+	}
+	// meme signe de direction sur chaque axe : les rayons traversent les boites dans le meme
+	// ordre, le paquet reste groupe dans la BVH. Sinon mieux vaut les tracer un par un.
+	bool coherent() const {
+		for (int a = 0; a < 3; a++) {
+			for (int l = 1; l < count; l++) {
+				if ((d[a][l] < 0) != (d[a][0] < 0)) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+};
+
+// Les centres et rayons d'un ensemble de spheres, en structure de tableaux (SoA) : les x de
+// toutes les spheres sont contigus, puis les y, etc. Un chargement vectoriel lit directement
+// une coordonnee de 4 (double) ou 8 (float) spheres consecutives.
+// Chaque sphere garde l'indice qu'elle a dans la scene : la BVH range ses feuilles dans un
+// autre ordre que la scene.
+class SphereSoA {
+	std::vector<double> cx_, cy_, cz_, r2_;
+	std::vector<float> fcx_, fcy_, fcz_, fr2_;
+	std::vector<uint32_t> index_;
+
+	static constexpr double NONE = std::numeric_limits<double>::max();
+
+public:
+	SphereSoA() = default;
+
+	void reserve(size_t n) {
+		for (auto * v : { &cx_, &cy_, &cz_, &r2_ }) {
+			v->reserve(n);
+		}
+		for (auto * v : { &fcx_, &fcy_, &fcz_, &fr2_ }) {
+			v->reserve(n);
+		}
+		index_.reserve(n);
+	}
+
+	void push_back(const Sphere & s, uint32_t index) {
+		const Vec3D & c = s.getCentre();
+		double r = s.getRadius();
+		cx_.push_back(c[0]);
+		cy_.push_back(c[1]);
+		cz_.push_back(c[2]);
+		r2_.push_back(r * r);
+		fcx_.push_back(float(c[0]));
+		fcy_.push_back(float(c[1]));
+		fcz_.push_back(float(c[2]));
+		fr2_.push_back(float(r * r));
+		index_.push_back(index);
+	}
+
+	size_t size() const { return index_.size(); }
+	bool empty() const { return index_.empty(); }
+	uint32_t index(size_t i) const { return index_[i]; }
+
+	// true si le processeur supporte les kernels AVX2
+	static bool hasAVX2() {
+		return cpuHasAVX2();
+	}
+
+	// le kernel effectivement utilise pour k sur ce processeur
+	static Isect effective(Isect k) {
+		return hasAVX2() ? k : Isect::Scalar;
+	}
+
+	// plus proche intersection parmi les spheres [first, last) : met a jour tbest et best (indice
+	// dans la scene) si une sphere est plus proche ; a egalite, le plus petit indice l'emporte,
+	// ce qui rend le resultat independant de l'ordre de parcours
+	void closest(const RayQuery & q, size_t first, size_t last, double & tbest, int & best, Isect k) const {
+#if PR_SIMD_AVX2
+		if (k != Isect::Scalar && hasAVX2()) {
+			if (k == Isect::Float) {
+				closestFloat(q, first, last, tbest, best);
+			} else {
+				closestDouble(q, first, last, tbest, best);
+			}
+			return;
+		}
+#endif
+		for (size_t i = first; i < last; i++) {
+			update(intersect(q, i), i, tbest, best);
+		}
+	}
+
+	// true si une des spheres [first, last), autre que celle d'indice ignore, est touchee avant tmax
+	bool any(const RayQuery & q, size_t first, size_t last, double tmax, int ignore, Isect k) const {
+#if PR_SIMD_AVX2
+		if (k != Isect::Scalar && hasAVX2()) {
+			return k == Isect::Float ? anyFloat(q, first, last, tmax, ignore) : anyDouble(q, first, last, tmax, ignore);
+		}
+#endif
+		for (size_t i = first; i < last; i++) {
+			if (int(index_[i]) != ignore && intersect(q, i) < tmax) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// distance a la sphere i, max si pas d'intersection : les memes operations, dans le meme
+	// ordre, que Sphere::intersects
+	double intersect(const RayQuery & q, size_t i) const {
+		double ocx = q.o[0] - cx_[i], ocy = q.o[1] - cy_[i], ocz = q.o[2] - cz_[i];
+		double b = 2.0 * (q.d[0] * ocx + q.d[1] * ocy + q.d[2] * ocz);
+		double c = (ocx * ocx + ocy * ocy + ocz * ocz) - r2_[i];
+		double disc = b * b - 4.0 * c;
+		if (disc < 0) {
+			return NONE;
+		}
+		double sq = std::sqrt(disc);
+		double near = (-b - sq) / 2.0;
+		double far = (-b + sq) / 2.0;
+		return near > 0 ? near : far > 0 ? far : NONE;
+	}
+
+#if PR_SIMD_AVX2
+	// plus proche intersection des rayons actifs du paquet (masque active) parmi les spheres
+	// [first, last), lane par lane comme closest ; une sphere a la fois contre 4 rayons.
+	// Kernel AVX2 double seulement : l'appelant verifie hasAVX2().
+	PR_TARGET_AVX2 void closestPacket(const RayPacket & p, int active, size_t first, size_t last, double * tbest, int * best) const {
+		const __m256d zero = _mm256_setzero_pd();
+		const __m256d none = _mm256_set1_pd(NONE);
+		const __m256d ox = _mm256_load_pd(p.o[0]), oy = _mm256_load_pd(p.o[1]), oz = _mm256_load_pd(p.o[2]);
+		const __m256d dx = _mm256_load_pd(p.d[0]), dy = _mm256_load_pd(p.d[1]), dz = _mm256_load_pd(p.d[2]);
+		alignas(32) double ts[4];
+		for (size_t i = first; i < last; i++) {
+			__m256d ocx = _mm256_sub_pd(ox, _mm256_set1_pd(cx_[i]));
+			__m256d ocy = _mm256_sub_pd(oy, _mm256_set1_pd(cy_[i]));
+			__m256d ocz = _mm256_sub_pd(oz, _mm256_set1_pd(cz_[i]));
+			__m256d dot = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, ocx), _mm256_mul_pd(dy, ocy)), _mm256_mul_pd(dz, ocz));
+			__m256d b = _mm256_mul_pd(_mm256_set1_pd(2.0), dot);
+			__m256d oc2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ocx, ocx), _mm256_mul_pd(ocy, ocy)), _mm256_mul_pd(ocz, ocz));
+			__m256d c = _mm256_sub_pd(oc2, _mm256_set1_pd(r2_[i]));
+			__m256d disc = _mm256_sub_pd(_mm256_mul_pd(b, b), _mm256_mul_pd(_mm256_set1_pd(4.0), c));
+			__m256d hit = _mm256_cmp_pd(disc, zero, _CMP_GE_OQ);
+			int cand = _mm256_movemask_pd(hit) & active;
+			if (cand == 0) {
+				continue;
+			}
+			__m256d sq = _mm256_sqrt_pd(_mm256_max_pd(disc, zero));
+			__m256d nb = _mm256_sub_pd(zero, b);
+			__m256d near = _mm256_mul_pd(_mm256_sub_pd(nb, sq), _mm256_set1_pd(0.5));
+			__m256d far = _mm256_mul_pd(_mm256_add_pd(nb, sq), _mm256_set1_pd(0.5));
+			__m256d t = _mm256_blendv_pd(none, far, _mm256_cmp_pd(far, zero, _CMP_GT_OQ));
+			t = _mm256_blendv_pd(t, near, _mm256_cmp_pd(near, zero, _CMP_GT_OQ));
+			cand &= _mm256_movemask_pd(_mm256_cmp_pd(t, _mm256_loadu_pd(tbest), _CMP_LE_OQ));
+			if (cand == 0) {
+				continue;
+			}
+			_mm256_store_pd(ts, t);
+			for (int l = 0; l < 4; l++) {
+				if (cand & (1 << l)) {
+					update(ts[l], i, tbest[l], best[l]);
+				}
+			}
+		}
+	}
+#endif
+
+private:
+	void update(double t, size_t i, double & tbest, int & best) const {
+		int idx = int(index_[i]);
+		if (t < tbest || (t == tbest && t != NONE && idx < best)) {
+			tbest = t;
+			best = idx;
+		}
+	}
+
+	// bits des lanes valides d'un bloc de width lanes, dont n restent a traiter
+	static int lanes(size_t n, int width) {
+		return n >= size_t(width) ? (1 << width) - 1 : (1 << n) - 1;
+	}
+
+#if PR_SIMD_AVX2
+	// les lanes >= n sont a zero dans le masque : ni lues, ni retenues
+	PR_TARGET_AVX2 static __m256i laneMask64(size_t n) {
+		return _mm256_cmpgt_epi64(_mm256_set1_epi64x(int64_t(n)), _mm256_setr_epi64x(0, 1, 2, 3));
+	}
+	PR_TARGET_AVX2 static __m256i laneMask32(size_t n) {
+		return _mm256_cmpgt_epi32(_mm256_set1_epi32(int(n)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+	}
+
+	// t de 4 spheres a partir de i ; les lanes invalides valent max.
+	// hits : lanes ou le rayon coupe la sphere (droite) ; le plus souvent aucune, et on
+	// s'arrete avant la racine et les divisions.
+	PR_TARGET_AVX2 __m256d intersect4(const RayQuery & q, size_t i, size_t n, int & hits) const {
+		const __m256i m = laneMask64(n);
+		const __m256d none = _mm256_set1_pd(NONE);
+		__m256d ocx = _mm256_sub_pd(_mm256_set1_pd(q.o[0]), _mm256_maskload_pd(&cx_[i], m));
+		__m256d ocy = _mm256_sub_pd(_mm256_set1_pd(q.o[1]), _mm256_maskload_pd(&cy_[i], m));
+		__m256d ocz = _mm256_sub_pd(_mm256_set1_pd(q.o[2]), _mm256_maskload_pd(&cz_[i], m));
+		__m256d dot = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_set1_pd(q.d[0]), ocx),
+		                                          _mm256_mul_pd(_mm256_set1_pd(q.d[1]), ocy)),
+		                            _mm256_mul_pd(_mm256_set1_pd(q.d[2]), ocz));
+		__m256d b = _mm256_mul_pd(_mm256_set1_pd(2.0), dot);
+		__m256d oc2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ocx, ocx), _mm256_mul_pd(ocy, ocy)), _mm256_mul_pd(ocz, ocz));
+		__m256d c = _mm256_sub_pd(oc2, _mm256_maskload_pd(&r2_[i], m));
+		__m256d disc = _mm256_sub_pd(_mm256_mul_pd(b, b), _mm256_mul_pd(_mm256_set1_pd(4.0), c));
+		__m256d hit = _mm256_and_pd(_mm256_cmp_pd(disc, _mm256_setzero_pd(), _CMP_GE_OQ), _mm256_castsi256_pd(m));
+		hits = _mm256_movemask_pd(hit);
+		if (hits == 0) {
+			return none;
+		}
+		__m256d sq = _mm256_sqrt_pd(_mm256_max_pd(disc, _mm256_setzero_pd()));
+		__m256d nb = _mm256_sub_pd(_mm256_setzero_pd(), b);
+		// * 0.5 : exactement / 2.0, sans division
+		__m256d near = _mm256_mul_pd(_mm256_sub_pd(nb, sq), _mm256_set1_pd(0.5));
+		__m256d far = _mm256_mul_pd(_mm256_add_pd(nb, sq), _mm256_set1_pd(0.5));
+		__m256d t = _mm256_blendv_pd(none, far, _mm256_cmp_pd(far, _mm256_setzero_pd(), _CMP_GT_OQ));
+		t = _mm256_blendv_pd(t, near, _mm256_cmp_pd(near, _mm256_setzero_pd(), _CMP_GT_OQ));
+		return _mm256_blendv_pd(none, t, hit);
+	}
+
+	// t de 8 spheres a partir de i, en float
+	PR_TARGET_AVX2 __m256 intersect8(const RayQuery & q, size_t i, size_t n, int & hits) const {
+		const __m256i m = laneMask32(n);
+		const __m256 none = _mm256_set1_ps(std::numeric_limits<float>::max());
+		__m256 ocx = _mm256_sub_ps(_mm256_set1_ps(float(q.o[0])), _mm256_maskload_ps(&fcx_[i], m));
+		__m256 ocy = _mm256_sub_ps(_mm256_set1_ps(float(q.o[1])), _mm256_maskload_ps(&fcy_[i], m));
+		__m256 ocz = _mm256_sub_ps(_mm256_set1_ps(float(q.o[2])), _mm256_maskload_ps(&fcz_[i], m));
+		__m256 dot = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(float(q.d[0])), ocx),
+		                                         _mm256_mul_ps(_mm256_set1_ps(float(q.d[1])), ocy)),
+		                           _mm256_mul_ps(_mm256_set1_ps(float(q.d[2])), ocz));
+		__m256 oc2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, ocx), _mm256_mul_ps(ocy, ocy)), _mm256_mul_ps(ocz, ocz));
+		__m256 c = _mm256_sub_ps(oc2, _mm256_maskload_ps(&fr2_[i], m));
+		// equation reduite (b/2) : meme racines, une multiplication de moins
+		__m256 disc = _mm256_sub_ps(_mm256_mul_ps(dot, dot), c);
+		__m256 hit = _mm256_and_ps(_mm256_cmp_ps(disc, _mm256_setzero_ps(), _CMP_GE_OQ), _mm256_castsi256_ps(m));
+		hits = _mm256_movemask_ps(hit);
+		if (hits == 0) {
+			return none;
+		}
+		__m256 sq = _mm256_sqrt_ps(_mm256_max_ps(disc, _mm256_setzero_ps()));
+		__m256 nd = _mm256_sub_ps(_mm256_setzero_ps(), dot);
+		__m256 near = _mm256_sub_ps(nd, sq);
+		__m256 far = _mm256_add_ps(nd, sq);
+		__m256 t = _mm256_blendv_ps(none, far, _mm256_cmp_ps(far, _mm256_setzero_ps(), _CMP_GT_OQ));
+		t = _mm256_blendv_ps(t, near, _mm256_cmp_ps(near, _mm256_setzero_ps(), _CMP_GT_OQ));
+		return _mm256_blendv_ps(none, t, hit);
+	}
+
+	PR_TARGET_AVX2 void closestDouble(const RayQuery & q, size_t first, size_t last, double & tbest, int & best) const {
+		alignas(32) double ts[4];
+		for (size_t i = first; i < last; i += 4) {
+			int hits;
+			__m256d t = intersect4(q, i, last - i, hits);
+			if (hits == 0) {
+				continue;
+			}
+			// rien de plus proche dans ce bloc : cas le plus frequent, une comparaison
+			int cand = _mm256_movemask_pd(_mm256_cmp_pd(t, _mm256_set1_pd(tbest), _CMP_LE_OQ));
+			cand &= lanes(last - i, 4);
+			if (cand == 0) {
+				continue;
+			}
+			_mm256_store_pd(ts, t);
+			for (int l = 0; l < 4; l++) {
+				if (cand & (1 << l)) {
+					update(ts[l], i + l, tbest, best);
+				}
+			}
+		}
+	}
+
+	PR_TARGET_AVX2 void closestFloat(const RayQuery & q, size_t first, size_t last, double & tbest, int & best) const {
+		alignas(32) float ts[8];
+		for (size_t i = first; i < last; i += 8) {
+			int hits;
+			__m256 t = intersect8(q, i, last - i, hits);
+			if (hits == 0) {
+				continue;
+			}
+			float fbest = tbest < std::numeric_limits<float>::max() ? float(tbest) : std::numeric_limits<float>::max();
+			int cand = _mm256_movemask_ps(_mm256_cmp_ps(t, _mm256_set1_ps(fbest), _CMP_LE_OQ));
+			// les lanes sans intersection valent max(float) : les ecarter
+			cand &= lanes(last - i, 8) & ~_mm256_movemask_ps(_mm256_cmp_ps(t, _mm256_set1_ps(std::numeric_limits<float>::max()), _CMP_EQ_OQ));
+			if (cand == 0) {
+				continue;
+			}
+			_mm256_store_ps(ts, t);
+			for (int l = 0; l < 8; l++) {
+				if (cand & (1 << l)) {
+					update(double(ts[l]), i + l, tbest, best);
+				}
+			}
+		}
+	}
+
+	PR_TARGET_AVX2 bool anyDouble(const RayQuery & q, size_t first, size_t last, double tmax, int ignore) const {
+		for (size_t i = first; i < last; i += 4) {
+			int hits;
+			__m256d t = intersect4(q, i, last - i, hits);
+			int cand = hits & _mm256_movemask_pd(_mm256_cmp_pd(t, _mm256_set1_pd(tmax), _CMP_LT_OQ));
+			cand &= lanes(last - i, 4);
+			for (int l = 0; cand != 0; l++, cand >>= 1) {
+				if ((cand & 1) && int(index_[i + l]) != ignore) {
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	PR_TARGET_AVX2 bool anyFloat(const RayQuery & q, size_t first, size_t last, double tmax, int ignore) const {
+		float fmax = tmax < std::numeric_limits<float>::max() ? float(tmax) : std::numeric_limits<float>::max();
+		for (size_t i = first; i < last; i += 8) {
+			int hits;
+			__m256 t = intersect8(q, i, last - i, hits);
+			int cand = hits & _mm256_movemask_ps(_mm256_cmp_ps(t, _mm256_set1_ps(fmax), _CMP_LT_OQ));
+			cand &= lanes(last - i, 8);
+			for (int l = 0; cand != 0; l++, cand >>= 1) {
+				if ((cand & 1) && int(index_[i + l]) != ignore) {
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+#endif
+};
+
+} /* namespace pr */
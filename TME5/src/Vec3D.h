@@ -8,13 +8,20 @@ namespace pr {
 // on l'appelle Vec3D car il propose les operations vectorielles usuelles
 class Vec3D {
 private:
-	const double x;
-	const double y;
-	const double z;
+	double x;
+	double y;
+	double z;
 
 public:
 	Vec3D(double x=0,double y=0,double z=0):x(x),y(y),z(z) {}
 
+	// coordonnees
+	double getX() const { return x; }
+	double getY() const { return y; }
+	double getZ() const { return z; }
+	// coordonnee par indice d'axe : 0 x, 1 y, 2 z
+	double operator[] (int axis) const { return axis == 0 ? x : axis == 1 ? y : z; }
+
 	// somme de vecteurs
 	Vec3D operator+ (const Vec3D & o) const { return Vec3D(x+o.x, y+o.y, z+o.z); }
 	// difference utile pour calculer un vecteur a partir de deux points
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace pr {
+
+// Work-stealing deque, after Chase & Lev ("Dynamic circular work-stealing deque", SPAA'05),
+// with the C11 memory orderings of Le, Pop, Cohen & Zappa Nardelli (PPoPP'13).
+// Store pointers to T, not T itself ; nullptr is returned when there is nothing to take.
+//
+// One owner thread pushes and pops at the bottom (LIFO : the most recent task, still hot
+// in cache), any number of thieves steal at the top (FIFO : the oldest, usually largest task).
+// Owner operations touch only bottom_ in the common case ; a CAS on top_ is needed only for
+// a steal, or when the owner takes the very last element and may race with a thief.
+//
+// The circular array grows when full (owner only). The old arrays are kept until the deque
+// is destroyed, because a thief may still be reading from them.
+template <typename T>
+class WSDeque {
+	struct Array {
+		const int64_t capacity;
+		std::atomic<T*> * slots;
+		explicit Array(int64_t cap) : capacity(cap), slots(new std::atomic<T*>[cap]) {}
+		~Array() { delete[] slots; }
+		T* get(int64_t i) const { return slots[i & (capacity - 1)].load(std::memory_order_relaxed); }
+		void put(int64_t i, T* x) { slots[i & (capacity - 1)].store(x, std::memory_order_relaxed); }
+		Array* grow(int64_t bottom, int64_t top) const {
+			Array* a = new Array(2 * capacity);
+			for (int64_t i = top; i < bottom; i++) {
+				a->put(i, get(i));
+			}
+			return a;
+		}
+	};
+	static constexpr size_t CACHE_LINE = 64;
+
+	alignas(CACHE_LINE) std::atomic<int64_t> top_;    // thieves side
+	alignas(CACHE_LINE) std::atomic<int64_t> bottom_; // owner side
+	std::atomic<Array*> array_;
+	std::vector<Array*> garbage_; // owner only
+
+public:
+	// capacity : initial, a power of two
+	explicit WSDeque(int64_t capacity = 256) : top_(0), bottom_(0), array_(new Array(capacity)) {}
+	WSDeque(const WSDeque &) = delete;
+	WSDeque & operator=(const WSDeque &) = delete;
+
+	// owner only
+	void push(T* x) {
+		int64_t b = bottom_.load(std::memory_order_relaxed);
+		int64_t t = top_.load(std::memory_order_acquire);
+		Array* a = array_.load(std::memory_order_relaxed);
+		if (b - t > a->capacity - 1) {
+			garbage_.push_back(a);
+			a = a->grow(b, t);
+			array_.store(a, std::memory_order_release);
+		}
+		a->put(b, x);
+		// publie l'element avant de le rendre visible aux voleurs
+		bottom_.store(b + 1, std::memory_order_release);
+	}
+
+	// owner only
+	T* pop() {
+		int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+		Array* a = array_.load(std::memory_order_relaxed);
+		bottom_.store(b, std::memory_order_relaxed);
+		// the reservation of b must be visible before we read top_ (a thief does the converse)
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t t = top_.load(std::memory_order_relaxed);
+		if (t > b) {
+			// vide
+			bottom_.store(b + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+		T* x = a->get(b);
+		if (t == b) {
+			// dernier element : course possible avec un voleur, le CAS tranche
+			if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+				x = nullptr;
+			}
+			bottom_.store(b + 1, std::memory_order_relaxed);
+		}
+		return x;
+	}
+
+	// any thread ; nullptr if empty, or if another thread won the race for the top element
+	T* steal() {
+		int64_t t = top_.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t b = bottom_.load(std::memory_order_acquire);
+		if (t >= b) {
+			return nullptr;
+		}
+		Array* a = array_.load(std::memory_order_acquire);
+		T* x = a->get(t);
+		if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+			return nullptr;
+		}
+		return x;
+	}
+
+	// approximate when used concurrently
+	bool empty() const {
+		int64_t b = bottom_.load(std::memory_order_acquire);
+		int64_t t = top_.load(std::memory_order_acquire);
+		return b <= t;
+	}
+
+	~WSDeque() {
+		// the elements themselves belong to the user of the deque
+		delete array_.load(std::memory_order_relaxed);
+		for (Array* a : garbage_) {
+			delete a;
+		}
+	}
+};
+
+} /* namespace pr */
@@ -1,16 +1,22 @@
 #include "Image.h"
 #include "Ray.h"
+#include "Animation.h"
+#include "CameraPath.h"
 #include "Renderer.h"
 #include "Scene.h"
 #include "SceneBuilder.h"
+#include "SceneIO.h"
 #include "Vec3D.h"
 #include <chrono>
 #include <filesystem>
+#include <functional>
 #include <iostream>
 #include <limits>
+#include <optional>
 #include <vector>
 
 #include "util/CLI11.hpp" // Header only lib for argument parsing
+#include "util/profiler.h"
 
 using namespace std;
 using namespace pr;
@@ -22,13 +28,48 @@ struct Options {
   int num_spheres = 250;
   std::string mode = "sequential";
   int nbthread = 4;
+  int tile = 32;
+  std::string accel = "bvh";
+  std::string isect = "double";
+  bool packets = false;
+  int aa = 1;
+  int aa_threshold = 24;
+  bool progressive = false;
+  int band = 0;
+  int frames = 1;
+  double orbit = 360;
+  int inflight = 0;
+  std::string scene;
+  std::string save_scene;
+  std::optional<uint64_t> seed;
+  std::string profile;
 
   friend std::ostream &operator<<(std::ostream &os, const Options &opts) {
-    os << "output '" << opts.output << "', resolution " << opts.width << "x" << opts.height
-       << ", spheres " << opts.num_spheres << ", mode " << opts.mode;
-    if (opts.mode == "ThreadManual" || opts.mode == "PoolPixel" || opts.mode == "PoolRow") {
+    os << "output '" << opts.output << "', resolution " << opts.width << "x" << opts.height << ", ";
+    if (opts.scene.empty()) {
+      os << "spheres " << opts.num_spheres;
+    } else {
+      os << "scene '" << opts.scene << "'";
+    }
+    os << " (" << opts.accel << ", " << opts.isect << "), mode " << opts.mode;
+    if (opts.mode == "ThreadManual" || opts.mode.rfind("Pool", 0) == 0) {
       os << ", threads " << opts.nbthread;
     }
+    if (opts.packets) {
+      os << ", ray packets";
+    }
+    if (opts.frames > 1) {
+      os << ", " << opts.frames << " frames over a " << opts.orbit << " degree orbit";
+    }
+    if (opts.band > 0) {
+      os << ", streamed in bands of " << opts.band << " rows";
+    }
+    if (opts.aa > 1) {
+      os << ", adaptive supersampling up to " << opts.aa << "x" << opts.aa;
+    }
+    if (opts.mode == "PoolTile") {
+      os << ", tiles " << opts.tile << "x" << opts.tile;
+    }
     return os;
   }
 };
@@ -45,43 +86,158 @@ int main(int argc, char *argv[]) {
 
   std::cout << "Ray tracer starting with " << opts << std::endl;
 
+  if (!opts.profile.empty()) {
+    pr::profile::enable();
+  }
+
   auto start = std::chrono::steady_clock::now();
 
   // definir la Scene : resolution de l'image
-  Scene scene = buildRandomScene(opts.width, opts.height, opts.num_spheres);
+  Scene scene(opts.width, opts.height);
+  {
+    PR_PROFILE_ZONE("buildScene");
+    if (opts.scene.empty()) {
+      // graine donnee, ou tiree au hasard mais affichee : la scene peut toujours etre reproduite
+      uint64_t seed = opts.seed ? *opts.seed : threadRng()();
+      mtseed(seed);
+      std::cout << "Random scene, seed " << seed << ".\n";
+      scene = buildRandomScene(opts.width, opts.height, opts.num_spheres, false,
+                               opts.mode == "sequential" ? 1 : opts.nbthread);
+    } else {
+      std::string error;
+      if (!loadScene(opts.scene, scene, error)) {
+        std::cerr << "Could not load scene " << opts.scene << ": " << error << std::endl;
+        return 1;
+      }
+      std::cout << "Loaded " << scene.getObjects().size() << " spheres and " << scene.getLights().size()
+                << " lights from " << opts.scene << ".\n";
+    }
+    if (opts.accel == "bvh") {
+      scene.buildBVH();
+    }
+  }
+  if (!opts.save_scene.empty()) {
+    if (!saveScene(scene, opts.save_scene)) {
+      std::cerr << "Could not write scene " << opts.save_scene << std::endl;
+      return 1;
+    }
+    std::cout << "Scene saved to " << opts.save_scene << ".\n";
+  }
+  scene.setIsect(opts.isect == "scalar" ? Isect::Scalar : opts.isect == "float" ? Isect::Float : Isect::Double);
+  if (SphereSoA::effective(scene.getIsect()) != scene.getIsect()) {
+    std::cout << "No AVX2 on this CPU : scalar intersection kernel.\n";
+  }
+  if (!scene.getBVH().empty()) {
+    std::cout << "BVH: " << scene.getBVH().nodeCount() << " nodes, depth " << scene.getBVH().depth() << ", scene built in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count()
+              << "ms.\n";
+  }
 
-  // L'image finale a produire
-  Image img(scene.getWidth(), scene.getHeight());
+  // L'image finale a produire ; en flux (--band), seulement des bandes, ecrites au fil du rendu
+  const bool streaming = opts.band > 0;
+  // une animation (--frames) : des images successives, chacune ecrite des qu'elle est rendue
+  const bool animated = opts.frames > 1;
+  std::optional<Image> img;
+  if (!streaming && !animated) {
+    img.emplace(scene.getWidth(), scene.getHeight());
+  }
 
   // Rendre la scène dans l'image
-  pr::Renderer renderer;
-  if (opts.mode == "sequential") {
-    renderer.render(scene, img);
-    /*
-           } else if (opts.mode == "ThreadPerPixel") {
-           renderer.renderThreadPerPixel(scene, img);
-       } else if (opts.mode == "ThreadPerRow") {
-           renderer.renderThreadPerRow(scene, img);
-       } else if (opts.mode == "ThreadManual") {
-           renderer.renderThreadManual(scene, img, opts.nbthread);
-       } else if (opts.mode == "PoolPixel") {
-           renderer.renderPoolPixel(scene, img, opts.nbthread);
-       } else if (opts.mode == "PoolRow") {
-           renderer.renderPoolRow(scene, img, opts.nbthread);
-       } else if (opts.mode == "PoolFunctionalRow") {
-           renderer.renderPoolFunctionalRow(scene, img, opts.nbthread);
-                   */
+  pr::Renderer renderer(opts.packets);
+  auto renderStart = std::chrono::steady_clock::now();
+  // un rayon primaire par pixel, plus les sous-pixels en anticrenelage
+  double rays = double(opts.width) * opts.height;
+  if (animated) {
+    PR_PROFILE_ZONE("render");
+    // autour du point de l'axe de vue le plus proche du centre des spheres : la premiere image
+    // est celle de la camera fixe
+    Vec3D lo(std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::max());
+    Vec3D hi = lo * -1.0;
+    for (const Sphere &s : scene.getObjects()) {
+      const Vec3D &c = s.getCentre();
+      lo = Vec3D(std::min(lo.getX(), c.getX()), std::min(lo.getY(), c.getY()), std::min(lo.getZ(), c.getZ()));
+      hi = Vec3D(std::max(hi.getX(), c.getX()), std::max(hi.getY(), c.getY()), std::max(hi.getZ(), c.getZ()));
+    }
+    const Camera &still = scene.getCamera();
+    Vec3D centre = scene.getObjects().empty() ? still.getPosition() + still.getViewDir() : (lo + hi) * 0.5;
+    double along = std::max((centre - still.getPosition()) & still.getViewDir(), 1.0);
+    CameraPath path = CameraPath::orbit(still.getPosition() + still.getViewDir() * along, still.getPosition(), opts.orbit);
+
+    Animation::Options anim{opts.frames, opts.mode == "sequential" ? 1 : opts.nbthread, opts.inflight};
+    std::cout << "Rendering " << anim.frames << " frames, "
+              << (anim.inflight > 0 ? std::min(anim.inflight, anim.frames)
+                                    : Animation::autoInflight(anim.nbthread, scene.getHeight(), anim.frames))
+              << " at a time.\n";
+    // spheres.bmp -> spheres_0000.bmp, spheres_0001.bmp...
+    const int digits = std::max(4, int(std::to_string(opts.frames - 1).size()));
+    auto frameFile = [&](int f) {
+      std::string n = std::to_string(f);
+      std::filesystem::path file(opts.output);
+      file.replace_filename(file.stem().string() + "_" + std::string(digits - n.size(), '0') + n + file.extension().string());
+      return file.string();
+    };
+    if (!Animation::render(scene, path, renderer, anim, frameFile)) {
+      std::cerr << "Could not write the frames " << frameFile(0) << "..." << std::endl;
+      return 1;
+    }
+    rays *= opts.frames;
+  } else if (streaming) {
+    PR_PROFILE_ZONE("render");
+    int threads = opts.mode == "sequential" ? 1 : opts.nbthread;
+    BMPWriter out(opts.output.c_str(), scene.getWidth(), scene.getHeight());
+    if (!renderer.renderStreaming(scene, out, opts.band, threads) || !out.close()) {
+      std::cerr << "Could not write " << opts.output << std::endl;
+      return 1;
+    }
+  } else if (opts.aa > 1) {
+    PR_PROFILE_ZONE("render");
+    // le mode ne sert qu'a choisir sequentiel ou non : l'anticrenelage a son propre decoupage
+    int threads = opts.mode == "sequential" ? 1 : opts.nbthread;
+    Renderer::Supersampling ss{opts.aa, opts.aa_threshold};
+    // sans --progressive, pas de callback : les bords vont directement a AA x AA rayons
+    std::function<void(int, const Image &)> progress;
+    if (opts.progressive) {
+      progress = [&](int spp, const Image &partial) {
+        // spheres.bmp -> spheres_4spp.bmp
+        std::filesystem::path path(opts.output);
+        path.replace_filename(path.stem().string() + "_" + std::to_string(spp) + "spp" + path.extension().string());
+        partial.exportToBMP(path.c_str());
+        std::cout << "Progressive: " << path.string() << std::endl;
+      };
+    }
+    auto stats = renderer.renderAdaptive(scene, *img, threads, ss, progress);
+    rays = double(stats.rays);
+    std::cout << "Supersampled " << stats.edges << " edge pixels of " << opts.width * opts.height << ".\n";
   } else {
-    std::cerr << "Unknown mode: " << opts.mode << std::endl;
-    return 1;
+    PR_PROFILE_ZONE("render");
+    if (!renderer.render(opts.mode, scene, *img, opts.nbthread, opts.tile)) {
+      std::cerr << "Unknown mode: " << opts.mode << std::endl;
+      return 1;
+    }
   }
 
   auto end = std::chrono::steady_clock::now();
+  double renderSeconds = std::chrono::duration<double>(end - renderStart).count();
+  std::cout << "Render time " << std::chrono::duration_cast<std::chrono::milliseconds>(end - renderStart).count()
+            << "ms, " << rays / renderSeconds / 1e6 << " Mrays/s.\n";
   std::cout << "Total time "
             << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
             << "ms.\n";
 
-  img.exportToBMP(opts.output.c_str());
+  if (img) {
+    PR_PROFILE_ZONE("exportToBMP");
+    if (!img->exportToBMP(opts.output.c_str())) {
+      std::cerr << "Could not write " << opts.output << std::endl;
+      return 1;
+    }
+  }
+
+  if (!opts.profile.empty()) {
+    pr::profile::report(std::cout);
+    if (!pr::profile::writeChromeTrace(opts.profile)) {
+      std::cerr << "Could not write trace to " << opts.profile << std::endl;
+    }
+  }
 
   return 0;
 }
@@ -105,15 +261,79 @@ int parseOptions(int argc, char *argv[], Options &opts) {
       ->check(CLI::PositiveNumber)
       ->default_val(default_opts.num_spheres);
 
+  cli_app.add_option("--scene", opts.scene,
+                     "Render the spheres and lights of this scene file (text, or binary cache) instead of a random scene")
+      ->check(CLI::ExistingFile);
+
+  cli_app.add_option("--seed", opts.seed,
+                     "Seed of the random scene : the same seed gives the same spheres, whatever the thread count")
+      ->excludes("--scene");
+
+  cli_app.add_option("--save-scene", opts.save_scene,
+                     "Save the spheres and lights of the scene to this file : binary cache if it ends in .bin, else text");
+
   cli_app.add_option("-m,--mode", opts.mode, "Processing mode")
-      ->check(CLI::IsMember({"sequential", "ThreadPerPixel", "ThreadPerRow", "ThreadManual",
-                             "PoolPixel", "PoolRow", "PoolFunctionalRow"}))
+      ->check(CLI::IsMember(Renderer::modes()))
       ->default_str(default_opts.mode);
 
   cli_app.add_option("-n,--nbthread", opts.nbthread, "Number of threads")
       ->check(CLI::PositiveNumber)
       ->default_val(default_opts.nbthread);
 
+  cli_app.add_option("--accel", opts.accel, "Acceleration structure : bvh, or none to test every sphere for every ray")
+      ->check(CLI::IsMember({"bvh", "none"}))
+      ->default_str(default_opts.accel);
+
+  cli_app.add_option("--isect", opts.isect,
+                     "Ray/sphere intersection kernel : scalar, double (AVX2, 4 spheres at once, same image), "
+                     "float (AVX2, 8 spheres at once, may differ on a few edge pixels)")
+      ->check(CLI::IsMember({"scalar", "double", "float"}))
+      ->default_str(default_opts.isect);
+
+  cli_app.add_flag("--packets", opts.packets,
+                   "Trace primary rays in packets of 4 (2x2 pixels, 4x1 in row modes) ; needs --isect double and AVX2");
+
+  cli_app.add_option("--aa", opts.aa,
+                     "Adaptive anti-aliasing : supersample edge pixels up to AA x AA rays (1 : off)")
+      ->check(CLI::PositiveNumber)
+      ->default_val(default_opts.aa);
+
+  cli_app.add_option("--aa-threshold", opts.aa_threshold,
+                     "Color difference (0-255, per channel) between neighbours that marks an edge pixel")
+      ->check(CLI::Range(0, 255))
+      ->default_val(default_opts.aa_threshold);
+
+  cli_app.add_flag("--progressive", opts.progressive,
+                   "With --aa, also write the image after each quality level, as <output>_<spp>spp.bmp");
+
+  cli_app.add_option("--band", opts.band,
+                     "Stream the image to the output file in bands of BAND rows, never holding it whole in memory (0 : off)")
+      ->check(CLI::NonNegativeNumber)
+      ->default_val(default_opts.band)
+      ->excludes("--aa"); // l'anticrenelage compare des pixels voisins de toute l'image
+
+  cli_app.add_option("--frames", opts.frames,
+                     "Render an animation of FRAMES images, the camera orbiting the spheres ; written as <output>_NNNN.bmp")
+      ->check(CLI::PositiveNumber)
+      ->default_val(default_opts.frames)
+      ->excludes("--aa")
+      ->excludes("--band");
+
+  cli_app.add_option("--orbit", opts.orbit, "Angle in degrees covered by the camera over the frames ; a multiple of 360 loops, "
+                     "its last frame stopping one step before the first")
+      ->default_val(default_opts.orbit);
+
+  cli_app.add_option("--inflight", opts.inflight, "Frames rendered at the same time (0 : from the threads and the height)")
+      ->check(CLI::NonNegativeNumber)
+      ->default_val(default_opts.inflight);
+
+  cli_app.add_option("--tile", opts.tile, "Tile size in pixels (PoolTile mode)")
+      ->check(CLI::PositiveNumber)
+      ->default_val(default_opts.tile);
+
+  cli_app.add_option("--profile", opts.profile,
+                     "Profile with nested zones : print a flat profile, write a Chrome trace (JSON) to this file");
+
   try {
     cli_app.parse(argc, argv);
   } catch (const CLI::CallForHelp &e) {
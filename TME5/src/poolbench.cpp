@@ -0,0 +1,160 @@
+// Micro benchmark of the Pool task API against spawning std::threads.
+//
+// Two workloads :
+//  - tasks : many independent small tasks returning a value. Compared : one std::thread per
+//    task (in waves of nbthread, each writing its result to an out-parameter), Pool::submit
+//    with a counter, and Pool::async / Future::get.
+//  - range : a sum over a large array. Compared : nbthread std::threads each taking a static
+//    slice, and Pool::parallel_for with several grain sizes.
+#include "Pool.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+#include "util/CLI11.hpp" // Header only lib for argument parsing
+
+using namespace std;
+using namespace pr;
+
+struct Options {
+  int nbthread = 4;
+  int tasks = 20000;
+  int work = 1000;
+  int range = 1 << 24;
+};
+
+// about a ns of integer work per iteration, not optimized away
+static uint64_t spin(uint64_t seed, int iterations) {
+  uint64_t x = seed | 1;
+  for (int i = 0; i < iterations; i++) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+  }
+  return x;
+}
+
+template <typename F>
+static double timeMs(F &&f) {
+  auto start = chrono::steady_clock::now();
+  f();
+  return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+static void report(const string &name, double ms, double count, uint64_t check) {
+  cout << "  " << left << setw(34) << name << right << setw(10) << fixed << setprecision(2) << ms << " ms"
+       << setw(12) << setprecision(0) << ms * 1e6 / count << " ns/item"
+       << "   (check " << check % 1000003 << ")" << endl;
+}
+
+int main(int argc, char *argv[]) {
+  Options opts;
+  CLI::App cli_app("Benchmark of Pool::submit/async/parallel_for against std::thread.");
+  cli_app.add_option("-n,--nbthread", opts.nbthread, "Number of threads")->check(CLI::PositiveNumber)->default_val(opts.nbthread);
+  cli_app.add_option("--tasks", opts.tasks, "Number of small tasks")->check(CLI::PositiveNumber)->default_val(opts.tasks);
+  cli_app.add_option("--work", opts.work, "Iterations of work per task")->check(CLI::NonNegativeNumber)->default_val(opts.work);
+  cli_app.add_option("--range", opts.range, "Size of the array summed by the range workload")->check(CLI::PositiveNumber)->default_val(opts.range);
+  CLI11_PARSE(cli_app, argc, argv);
+
+  const int n = opts.nbthread;
+  const int ntasks = opts.tasks;
+  cout << "Threads " << n << ", " << ntasks << " tasks of " << opts.work << " iterations, range " << opts.range << endl;
+
+  Pool pool(1024);
+  pool.start(n);
+
+  cout << "tasks:" << endl;
+  {
+    vector<uint64_t> results(ntasks);
+    double ms = timeMs([&] {
+      for (int base = 0; base < ntasks; base += n) {
+        vector<thread> wave;
+        for (int i = base; i < min(ntasks, base + n); i++) {
+          wave.emplace_back([&results, i, &opts] { results[i] = spin(i, opts.work); });
+        }
+        for (auto &t : wave) {
+          t.join();
+        }
+      }
+    });
+    report("std::thread per task", ms, ntasks, accumulate(results.begin(), results.end(), uint64_t(0)));
+  }
+  {
+    vector<uint64_t> results(ntasks);
+    atomic<int> done{0};
+    double ms = timeMs([&] {
+      for (int i = 0; i < ntasks; i++) {
+        pool.submit([&results, &done, i, &opts] {
+          results[i] = spin(i, opts.work);
+          done.fetch_add(1, memory_order_release);
+        });
+      }
+      while (done.load(memory_order_acquire) < ntasks) {
+        this_thread::yield();
+      }
+    });
+    report("Pool::submit + counter", ms, ntasks, accumulate(results.begin(), results.end(), uint64_t(0)));
+  }
+  {
+    uint64_t sum = 0;
+    double ms = timeMs([&] {
+      vector<Future<uint64_t>> futures;
+      futures.reserve(ntasks);
+      for (int i = 0; i < ntasks; i++) {
+        futures.push_back(pool.async([i, &opts] { return spin(i, opts.work); }));
+      }
+      for (auto &f : futures) {
+        sum += f.get();
+      }
+    });
+    report("Pool::async + get", ms, ntasks, sum);
+  }
+
+  cout << "range:" << endl;
+  vector<uint64_t> data(opts.range);
+  iota(data.begin(), data.end(), uint64_t(0));
+  const size_t size = data.size();
+  {
+    vector<uint64_t> partial(n);
+    double ms = timeMs([&] {
+      vector<thread> threads;
+      for (int t = 0; t < n; t++) {
+        threads.emplace_back([&, t] {
+          size_t lo = size * t / n, hi = size * (t + 1) / n;
+          uint64_t s = 0;
+          for (size_t i = lo; i < hi; i++) {
+            s += spin(data[i], 4);
+          }
+          partial[t] = s;
+        });
+      }
+      for (auto &t : threads) {
+        t.join();
+      }
+    });
+    report("std::thread static slices", ms, double(size), accumulate(partial.begin(), partial.end(), uint64_t(0)));
+  }
+  for (size_t grain : {size_t(256), size_t(4096), size_t(65536)}) {
+    atomic<uint64_t> sum{0};
+    double ms = timeMs([&] {
+      // one chunk at a time : accumulate locally per chunk, publish once
+      pool.parallel_for(0, (size + grain - 1) / grain, 1, [&](size_t c) {
+        size_t lo = c * grain, hi = min(size, lo + grain);
+        uint64_t s = 0;
+        for (size_t i = lo; i < hi; i++) {
+          s += spin(data[i], 4);
+        }
+        sum.fetch_add(s, memory_order_relaxed);
+      });
+    });
+    report("Pool::parallel_for grain " + to_string(grain), ms, double(size), sum.load());
+  }
+
+  pool.stop();
+  return 0;
+}
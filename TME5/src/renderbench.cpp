@@ -0,0 +1,212 @@
+// Benchmark of the rendering modes of Renderer, written as CSV.
+//
+// For each resolution and scene (a saved scene file, or random scenes of several sizes from a
+// fixed seed), every selected mode renders the same image, reps times for each thread count.
+// The modes that do not take a thread count (sequential, ThreadPerPixel, ThreadPerRow) run
+// once per scene. One CSV row per configuration :
+//  - median and best wall time of the repetitions, primary rays per second (from the median) ;
+//  - speedup against sequential on the same scene, and parallel efficiency (speedup / threads) ;
+//  - CPU time of the process during a render (all threads, median), and its average per
+//    thread (cpu_ms_per_thread_avg). The threads live inside each mode, so no thread is
+//    measured alone : this is the total divided by the thread count. Compared to the wall
+//    time, it shows how busy the threads were on average.
+#include "Image.h"
+#include "Renderer.h"
+#include "Scene.h"
+#include "SceneBuilder.h"
+#include "SceneIO.h"
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "util/CLI11.hpp" // Header only lib for argument parsing
+
+using namespace std;
+using namespace pr;
+
+struct Options {
+  vector<string> modes = Renderer::modes();
+  vector<int> threads = {1, 2, 4, 8};
+  vector<string> resolutions = {"400x300", "800x600"};
+  vector<int> spheres = {250, 10000};
+  string scene;
+  uint64_t seed = 1;
+  int reps = 3;
+  int tile = 32;
+  string accel = "bvh";
+  bool packets = false;
+  string output = "-";
+};
+
+struct Resolution {
+  int width, height;
+};
+
+// CPU time (user + system) of the whole process, all threads, in ms
+static double processCpuMs() {
+  timespec now;
+  if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now) != 0) {
+    return 0;
+  }
+  return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+static double median(vector<double> v) {
+  sort(v.begin(), v.end());
+  size_t n = v.size();
+  return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+// the modes that use nbthread ; the others run once per scene
+static bool takesThreads(const string &mode) {
+  return mode == "ThreadManual" || mode.rfind("Pool", 0) == 0;
+}
+
+// threads working on the image : none for ThreadPerPixel and ThreadPerRow, which start one
+// per pixel or per row, a few at a time
+static optional<int> threadsUsed(const string &mode, int nbthread) {
+  if (takesThreads(mode)) {
+    return nbthread;
+  }
+  return mode == "sequential" ? optional<int>(1) : nullopt;
+}
+
+int main(int argc, char *argv[]) {
+  Options opts;
+  CLI::App cli_app("Benchmark of the rendering modes : Mrays/s, speedup, parallel efficiency and CPU time, as CSV.");
+  cli_app.add_option("-m,--modes", opts.modes, "Rendering modes")
+      ->check(CLI::IsMember(Renderer::modes()))
+      ->delimiter(',')
+      ->default_str("all");
+  cli_app.add_option("-n,--threads", opts.threads, "Thread counts, for the modes that take one")
+      ->check(CLI::PositiveNumber)
+      ->delimiter(',')
+      ->default_str("1,2,4,8");
+  cli_app.add_option("-r,--resolutions", opts.resolutions, "Image sizes, WIDTHxHEIGHT")
+      ->delimiter(',')
+      ->default_str("400x300,800x600");
+  cli_app.add_option("-s,--spheres", opts.spheres, "Sphere counts of the random scenes")
+      ->check(CLI::PositiveNumber)
+      ->delimiter(',')
+      ->default_str("250,10000");
+  cli_app.add_option("--scene", opts.scene, "Render this saved scene (cf. TME5 --save-scene) instead of random scenes")
+      ->check(CLI::ExistingFile)
+      ->excludes("--spheres");
+  cli_app.add_option("--seed", opts.seed, "Seed of the random scenes")->default_val(opts.seed);
+  cli_app.add_option("--reps", opts.reps, "Repetitions of each configuration")->check(CLI::PositiveNumber)->default_val(opts.reps);
+  cli_app.add_option("--tile", opts.tile, "Tile size in pixels (PoolTile mode)")->check(CLI::PositiveNumber)->default_val(opts.tile);
+  cli_app.add_option("--accel", opts.accel, "Acceleration structure : bvh or none")
+      ->check(CLI::IsMember({"bvh", "none"}))
+      ->default_val(opts.accel);
+  cli_app.add_flag("--packets", opts.packets, "Trace primary rays in packets of 4");
+  cli_app.add_option("-o,--output", opts.output, "CSV file, - for the standard output")->default_val(opts.output);
+  CLI11_PARSE(cli_app, argc, argv);
+
+  vector<Resolution> resolutions;
+  for (const string &r : opts.resolutions) {
+    Resolution res;
+    char x;
+    istringstream in(r);
+    if (!(in >> res.width >> x >> res.height) || x != 'x' || res.width <= 0 || res.height <= 0 || !in.eof()) {
+      cerr << "Bad resolution " << r << ", expected WIDTHxHEIGHT" << endl;
+      return 1;
+    }
+    resolutions.push_back(res);
+  }
+  // in the order of Renderer::modes : sequential first, the reference of the speedups
+  vector<string> modes;
+  for (const string &m : Renderer::modes()) {
+    if (find(opts.modes.begin(), opts.modes.end(), m) != opts.modes.end()) {
+      modes.push_back(m);
+    }
+  }
+  // the loaded scene, or one per sphere count
+  vector<int> sceneSizes = opts.scene.empty() ? opts.spheres : vector<int>{0};
+
+  ofstream file;
+  if (opts.output != "-") {
+    file.open(opts.output);
+    if (!file) {
+      cerr << "Could not write " << opts.output << endl;
+      return 1;
+    }
+  }
+  ostream &csv = opts.output == "-" ? cout : file;
+  csv << "mode,threads,width,height,spheres,reps,median_ms,best_ms,mrays_per_s,speedup,efficiency,cpu_ms,cpu_ms_per_thread_avg\n";
+
+  Renderer renderer(opts.packets);
+  for (const Resolution &res : resolutions) {
+    for (int nspheres : sceneSizes) {
+      Scene scene(res.width, res.height);
+      if (opts.scene.empty()) {
+        // the same seed for every resolution : the same spheres
+        mtseed(opts.seed);
+        scene = buildRandomScene(res.width, res.height, nspheres, false);
+      } else {
+        string error;
+        if (!loadScene(opts.scene, scene, error)) {
+          cerr << "Could not load scene " << opts.scene << ": " << error << endl;
+          return 1;
+        }
+      }
+      if (opts.accel == "bvh") {
+        scene.buildBVH();
+      }
+      const size_t objects = scene.getObjects().size();
+      const double rays = double(res.width) * res.height;
+      Image img(res.width, res.height);
+
+      optional<double> sequentialMs;
+      for (const string &mode : modes) {
+        vector<int> threadCounts = takesThreads(mode) ? opts.threads : vector<int>{1};
+        for (int nbthread : threadCounts) {
+          cerr << mode << " " << res.width << "x" << res.height << ", " << objects << " spheres";
+          if (takesThreads(mode)) {
+            cerr << ", " << nbthread << " threads";
+          }
+          cerr << endl;
+          vector<double> wall, cpu;
+          for (int rep = 0; rep < opts.reps; rep++) {
+            double cpu0 = processCpuMs();
+            auto start = chrono::steady_clock::now();
+            renderer.render(mode, scene, img, nbthread, opts.tile);
+            wall.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+            cpu.push_back(processCpuMs() - cpu0);
+          }
+          double ms = median(wall);
+          double cpuMs = median(cpu);
+          if (mode == "sequential") {
+            sequentialMs = ms;
+          }
+          optional<int> used = threadsUsed(mode, nbthread);
+          csv << mode << ",";
+          if (used) {
+            csv << *used;
+          }
+          csv << "," << res.width << "," << res.height << "," << objects << "," << opts.reps << fixed << setprecision(3)
+              << "," << ms << "," << *min_element(wall.begin(), wall.end()) << "," << rays / ms / 1e3 << ",";
+          if (sequentialMs) {
+            csv << *sequentialMs / ms;
+          }
+          csv << ",";
+          if (sequentialMs && used) {
+            csv << *sequentialMs / ms / *used;
+          }
+          csv << "," << cpuMs << ",";
+          if (used) {
+            csv << cpuMs / *used;
+          }
+          csv << defaultfloat << "\n" << flush;
+        }
+      }
+    }
+  }
+  return 0;
+}
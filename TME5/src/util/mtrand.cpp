@@ -3,9 +3,17 @@
 #include "util/mtrand.h"
 
 
+pr::Xoshiro256 & pr::threadRng() {
+    static thread_local Xoshiro256 generator{(uint64_t(std::random_device{}()) << 32) ^ std::random_device{}()};
+    return generator;
+}
+
+void pr::mtseed(uint64_t seed) {
+    threadRng() = Xoshiro256(seed);
+}
+
 // Thread-safe random number generator: [lo, hi), lo inclusive, hi exclusive
 int pr::mtrand(int lo, int hi) {
     assert(lo < hi);
-    static thread_local std::mt19937 generator{std::random_device{}()};
-    return std::uniform_int_distribution<int>{lo, hi - 1}(generator);
+    return threadRng().range(lo, hi);
 }
@@ -1,7 +1,89 @@
 #pragma once
+#include <cstdint>
 #include <limits>
 
 namespace pr {
+  // xoshiro256** (Blackman, Vigna) : 4 x 64 bits of state, a few shifts and rotations per number.
+  // jump() advances by 2^128 numbers : from one seed, stream k (k jumps) never overlaps stream
+  // k + 1, which gives reproducible, independent generators to parallel tasks.
+  class Xoshiro256 {
+    uint64_t s[4];
+
+    static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+  public:
+    using result_type = uint64_t;
+
+    // the state is filled by splitmix64 from seed, as advised by the authors
+    explicit Xoshiro256(uint64_t seed = 0) {
+      for (auto & w : s) {
+        seed += 0x9e3779b97f4a7c15ULL;
+        uint64_t z = seed;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        w = z ^ (z >> 31);
+      }
+    }
+
+    static constexpr uint64_t min() { return 0; }
+    static constexpr uint64_t max() { return std::numeric_limits<uint64_t>::max(); }
+
+    uint64_t operator()() {
+      const uint64_t result = rotl(s[1] * 5, 7) * 9;
+      const uint64_t t = s[1] << 17;
+      s[2] ^= s[0];
+      s[3] ^= s[1];
+      s[1] ^= s[2];
+      s[0] ^= s[3];
+      s[2] ^= t;
+      s[3] = rotl(s[3], 45);
+      return result;
+    }
+
+    // same as 2^128 calls to operator()
+    void jump() {
+      static constexpr uint64_t JUMP[] = {0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL, 0xa9582618e03fc9aaULL,
+                                          0x39abdc4529b1661cULL};
+      uint64_t t[4] = {0, 0, 0, 0};
+      for (uint64_t j : JUMP) {
+        for (int b = 0; b < 64; b++) {
+          if (j & (uint64_t(1) << b)) {
+            for (int i = 0; i < 4; i++) {
+              t[i] ^= s[i];
+            }
+          }
+          (*this)();
+        }
+      }
+      for (int i = 0; i < 4; i++) {
+        s[i] = t[i];
+      }
+    }
+
+    // uniform in [lo, hi), lo inclusive, hi exclusive : unbiased, and the same sequence on every
+    // platform (unlike std::uniform_int_distribution, whose algorithm is up to the library)
+    int range(int lo, int hi) {
+      const uint32_t span = uint32_t(int64_t(hi) - lo);
+      // Lemire : the high 32 bits of x * span, for x the high 32 bits of a draw, redrawn in the
+      // rare biased cases
+      uint64_t m = ((*this)() >> 32) * span;
+      if (uint32_t(m) < span) {
+        const uint32_t threshold = uint32_t(-span) % span;
+        while (uint32_t(m) < threshold) {
+          m = ((*this)() >> 32) * span;
+        }
+      }
+      return int(lo + int64_t(m >> 32));
+    }
+  };
+
+  // the generator of the calling thread, seeded from std::random_device at its first use
+  Xoshiro256 & threadRng();
+
+  // reseed the generator of the calling thread : the same seed gives the same numbers
+  void mtseed(uint64_t seed);
+
   // Thread-safe random number generator: [lo, hi), lo inclusive, hi exclusive
+  // draws from the generator of the calling thread, with no lock nor shared state
   int mtrand(int lo = 0, int hi = std::numeric_limits<int>::max());
 }